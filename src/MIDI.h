@@ -1,40 +1,33 @@
 #pragma once
 
 #include <fluidsynth.h>
-#include <RtMidi.h>
-// #include <MidiFile.h>
 
+#include "data/ActiveVoices.h"
+#include "output/OutputSink.h"
 
+#include <memory>
+
+
+/** Note bookkeeping in front of an output sink (FluidSynth by default, see output/) */
 class MIDI {
 public:
-	MIDI();
+	explicit MIDI(std::unique_ptr<OutputSink> sink);
 	void selectProgram(unsigned char channel, int instrument) const;
-	~MIDI();
-	void loadSoundfont(const std::string& soundfont);
-
-	void playNote(Note note, unsigned char channel, unsigned char velocity) const;
-	void stopNote(Note note, unsigned char channel) const;
+	void useSoundfont(fluid_sfont_t* soundfont) const;
+	LoadedSoundfont loadSoundfont(const std::string& path) const { return sink->loadSoundfont(path); }
+	void configure(const SynthSettings& settings) const { sink->configure(settings); }
 
-	void stopAll() const;
+	[[nodiscard]] OutputSink& getSink() const { return *sink; }
+	[[nodiscard]] SynthLoad getLoad() const { return sink->getLoad(); }  // CPU load, active voices, polyphony limit
 
+	void playNote(Note note, unsigned char channel, unsigned char velocity);
+	void stopNote(Note note, unsigned char channel);
 
-	// Live recording (unused)
-	// void prepareLiveMIDIFile();
-	// smf::MidiFile& getLiveMIDIFile() { return liveMidiFile; }
-
-	// [[nodiscard]] std::vector<unsigned char> getMessage() const;
-	// void finishRecording() const;
-
-	// void addNoteOn (int ticks, Note note, unsigned char channel, unsigned char velocity);
-	// void addNoteOff(int ticks, Note note, unsigned char channel, unsigned char velocity);
+	void stopChannel(unsigned char channel);
+	void stopAll();
 
 private:
-	fluid_settings_t* settings	  = nullptr;
-	fluid_synth_t* synth		  = nullptr;
-	fluid_audio_driver_t *adriver = nullptr;
-
-	int sfid{};
+	std::unique_ptr<OutputSink> sink;
 
-	// RtMidiIn* midiIn;
-	// smf::MidiFile liveMidiFile;
+	ActiveVoices activeVoices;  // Notes currently sounding per channel
 };
@@ -3,13 +3,17 @@
 using namespace std;
 
 
-void MelodyMaker::initMarkovChain(const int markovChainOrder, const Melody& melody) {
-	mc	   = MarkovChain(markovChainOrder);
-	buffer = FixedQueue(markovChainOrder + 1);  // + 1 for next note (only for training)
+// Shared START token, only its note is ever compared
+static const T START_EVENT = make_shared<SimpleEvent>(START);
+
+
+/** Train a Markov chain of the given order on the melody */
+MarkovChain MelodyMaker::trainMarkovChain(const int markovChainOrder, const Melody& melody) {
+	MarkovChain mc(markovChainOrder);
+	FixedQueue buffer(markovChainOrder + 1);  // + 1 for next note (only for training)
 
 	// Initialize buffer with START token events
-	for (int i = 0; i < buffer.maxSize; i++)
-		buffer.push(make_shared<SimpleEvent>(START));
+	buffer.fill(START_EVENT);
 
 	// Train the Markov model using the provided MIDI file
 	cout << "[MelodyMaker] Training order " << markovChainOrder << " Markov chain...\n";
@@ -19,22 +23,26 @@ void MelodyMaker::initMarkovChain(const int markovChainOrder, const Melody& melo
 	}
 	cout << "[MelodyMaker] Markov chain training done.\n";
 
-	// Reset play buffer for playback mode
+	return mc;
+}
+
+/** Use a trained Markov chain for playback */
+void MelodyMaker::initMarkovChain(shared_ptr<const MarkovChain> chain, const int markovChainOrder) {
+	mc	   = move(chain);
 	buffer = FixedQueue(markovChainOrder);  // No + 1 needed for playback mode
 
 	// Initialize buffer with START token events
-	for (int i = 0; i < buffer.maxSize; i++)
-		buffer.push(make_shared<SimpleEvent>(START));
+	buffer.fill(START_EVENT);
+
+	stream = generate();
 }
 
 
-shared_ptr<Event> MelodyMaker::handleNoResult() {
+MarkovSample MelodyMaker::handleNoResult() {
 	// No valid continuation, reset buffer with START tokens
-	buffer = FixedQueue(buffer.size());
-	for (int i = 0; i < buffer.maxSize; ++i)
-		buffer.push(make_shared<SimpleEvent>(START));
+	buffer.fill(START_EVENT);
 
-	const auto result = mc.getNext(buffer.getSnapshot());
+	const auto result = mc->sample(buffer.view());
 	if (!result.has_value()) {
 		cout << "[MelodyMaker] No valid continuation found. The input MIDI is likely empty.\n";
 		exit(EXIT_FAILURE);
@@ -44,11 +52,21 @@ shared_ptr<Event> MelodyMaker::handleNoResult() {
 }
 
 
-shared_ptr<Event> MelodyMaker::pollNextEvent() {
-	const auto context = buffer.getSnapshot();
-	auto result = mc.getNextWithFallback(context);
-	if (!result.has_value()) result = handleNoResult();
-	shared_ptr<Event> event = *result;
-	buffer.push(event);
-	return event;
+/**
+ * Walk the Markov chain lazily.
+ * The context is looked up in place and the chain's own events are pushed to it, so no step allocates.
+ */
+Generator<MelodyStep> MelodyMaker::generate() {
+	while (true) {
+		auto result = mc->sampleWithFallback(buffer.view());
+		if (!result.has_value()) result = handleNoResult();
+
+		const T& event = *result->next;
+		buffer.push(event);
+
+		// Skip START tokens
+		if (!dynamic_cast<const FixedEvent*>(event.get())) continue;
+
+		co_yield MelodyStep{event->note, result->duration};
+	}
 }
@@ -1,16 +1,31 @@
 #pragma once
 
 #include "data/MarkovChain.h"
+#include "util/Generator.h"
+
+
+/** One generated melody note (or PAUSE), before it is mapped to a scale and placed on the timeline */
+struct MelodyStep {
+	Note note;
+	double duration;  // In microseconds at the tempo of the input melody
+};
 
 
 class MelodyMaker {
 public:
-	void initMarkovChain(int markovChainOrder, const Melody& melody);
-	std::shared_ptr<Event> pollNextEvent();
+	static MarkovChain trainMarkovChain(int markovChainOrder, const Melody& melody);
+
+	void initMarkovChain(std::shared_ptr<const MarkovChain> chain, int markovChainOrder);
+	void useChain(std::shared_ptr<const MarkovChain> chain) { mc = std::move(chain); }  // Same order, keeps the context
+
+	/** Endless stream of melody steps, continues where the previous read stopped */
+	Generator<MelodyStep>& events() { return stream; }
 
 private:
-	MarkovChain mc;
+	std::shared_ptr<const MarkovChain> mc;  // Trained chain, may be shared with other sessions
 	FixedQueue buffer;
+	Generator<MelodyStep> stream;
 
-	std::shared_ptr<Event> handleNoResult();
+	Generator<MelodyStep> generate();
+	MarkovSample handleNoResult();
 };
@@ -1,7 +1,14 @@
 #include "MusicMaker.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cfloat>
 
+#include "output/FluidSynthSink.h"
+#include "output/NullSink.h"
+#include "output/RecordingSink.h"
+#include "output/SMFSink.h"
+
 #include "util/Debug.h"
 
 using namespace std;
@@ -12,384 +19,659 @@ constexpr bool DEBUG_JSON = false;
 
 constexpr bool OFFLINE_MODE = false;  // Doesn't require connection to a game to generate music
 
+constexpr auto TIMING_CSV = "timing_results.csv";  // Written next to perf_results.csv
+
+// Each measure is generated this long before it starts. Once generation takes longer, cheaper fallbacks are used.
+constexpr auto GENERATION_BUDGET = chrono::milliseconds(20);
+
+constexpr auto SOUNDFONT = "soundfonts/FluidR3_GM.sf2";
+
+constexpr size_t REALTIME_SCHEDULER_CAPACITY = 16384;  // Scheduler nodes pre-allocated in real-time mode
+
+
+static unique_ptr<OutputSink> makeOutputSink(const SessionConfig& config) {
+	if (!config.recordPath.empty()) {
+		SessionConfig unrecorded = config;
+		unrecorded.recordPath.clear();
+		return make_unique<RecordingSink>(makeOutputSink(unrecorded), config.recordPath);
+	}
+
+	switch (config.output) {
+		case OutputType::NONE:
+			return make_unique<NullSink>();
+		case OutputType::SMF:
+			return make_unique<SMFSink>(!config.outputPath.empty()
+				? config.outputPath
+				: "session" + (config.name.empty() ? "" : "_" + config.name) + ".mid");
+		default:
+			return make_unique<FluidSynthSink>(config.synth);
+	}
+}
+
+MusicMaker::MusicMaker(SessionConfig config, shared_ptr<SharedResources> resources)
+	: config(move(config)), resources(move(resources)), gb(this->config.port), midi(makeOutputSink(this->config)) {}
+
+/** finish() normally stopped the game state thread already, unless the session failed before that */
+MusicMaker::~MusicMaker() {
+	stopGameStateThread();
+	for (const auto& [data, bytes] : lockedMemory) unlockMemory(data, bytes);
+}
+
 
 void MusicMaker::start() {
+	prepare();
+	play();
+	finish();
+}
+
+
+/** Load rules and input, train (or reuse) the model and start listening for the game */
+void MusicMaker::prepare() {
 	isRunning.store(true, memory_order_release);
 	stopRequested.store(false, memory_order_relaxed);
+	prepareStart = Clock::now();
 
-	// Load MIDI soundfont
-	midi.loadSoundfont("soundfonts/FluidR3_GM.sf2");
+	// Load Lua bindings
+	bindMusicFunctions();
+
+	// Load setup.lua for input MIDI file and user-defined rules (and synth settings)
+	loadLuaRules();
+	validateAllRules();
+
+	// Load the soundfont in the background while the MIDI input is parsed and the model trained.
+	// It is shared with all other sessions, unless dynamic sample loading needs a private one.
+	const shared_future<LoadedSoundfont> soundfontLoad = config.synth.dynamicSampleLoading
+		? async(launch::async, [this] { return midi.loadSoundfont(SOUNDFONT); }).share()
+		: resources->loadSoundfontAsync(SOUNDFONT);
+
+	// Train the Markov chain, or reuse the one of a session with the same input and order
+	const string modelKey = mainMIDIFilePath + '#' + (autoMarkov ? "auto" : to_string(markovOrder));
+	model = resources->getModel(modelKey, [this] { return trainModel(); });
+
+	// Use the soundfont (waiting for the rest of its load, if any), this starts the synth
+	const auto waitStart = Clock::now();
+	const LoadedSoundfont& soundfont = soundfontLoad.get();
+	timingStats.startup.soundfontWaitTime = microsBetween(waitStart, Clock::now());
+	timingStats.startup.soundfontLoadTime = chrono::duration_cast<chrono::microseconds>(soundfont.loadTime).count();
+	if (!config.synth.dynamicSampleLoading) midi.useSoundfont(soundfont.sfont);
 
 	// Initialize instrument channels
 	midi.selectProgram(LEAD.channel,   LEAD.program);
 	midi.selectProgram(CHORDS.channel, CHORDS.program);
 	midi.selectProgram(BASS.channel,   BASS.program);
 
-	// Load Lua bindings
-	bindMusicFunctions();
+	// Extract bpm and time signature
+	tsInfo = model->tsInfo;
+	originalBpm = tsInfo.bpm;
 
-	// Load setup.lua for input MIDI file and user-defined rules
-	loadLuaRules();
-	validateAllRules();
+	// Initialize note buffer for playback
+	mm.initMarkovChain(shared_ptr<const MarkovChain>(model, &model->chain), model->order);
+
+	// Keep training on live input, starting from the trained chain
+	if (config.liveInputPort >= 0) {
+		liveInput = make_unique<LiveMIDIInput>(model->chain, model->order, model->tsInfo);
+		if (!liveInput->open(config.liveInputPort)) liveInput.reset();
+	}
+
+	// Load logic.lua and bind remaining music functions
+	loadLuaLogic();
+
+	// Initialize music state
+	onStart();
+	publishMusicState();
+
+	// Compile the drum patterns for the input's meter, once rules.lua, logic.lua and on_start had their chance to define them
+	drumPatterns = drumPatternLibrary.compile(tsInfo);
+	drumPatternsCompiled = true;
+
+	if constexpr (!OFFLINE_MODE) {
+		// Start the socket server (the connection is awaited by the game state thread).
+		// Without a listener no game could ever connect, so the session would wait forever
+		if (!gb.startGameStateListener())
+			throw runtime_error("Failed to listen for the game on port " + to_string(config.port));
+		startGameStateThread();
+	}
+
+	// Pre-allocate the scheduler, so that dispatch doesn't allocate, and keep the playback working set resident.
+	// play() or the host's worker raises its own priority and locks its stack (enterRealTimeMode()).
+	if (config.realTime) {
+		scheduler.reserve(REALTIME_SCHEDULER_CAPACITY);
+		lockPlaybackMemory();
+	}
+
+	prepareEnd = Clock::now();
+	timingStats.startup.prepareTime = microsBetween(prepareStart, prepareEnd);
+}
+
+
+/** Extract the melody from the main MIDI file and train the Markov chain on it */
+TrainedModel MusicMaker::trainModel() const {
+	TrainedModel trained;
 
 	// Get input training MIDI
-	MidiFile mainMIDIFile = getCachedMIDI(mainMIDIFilePath);
+	MidiFile mainMIDIFile = *getCachedMIDI(mainMIDIFilePath);
 
 	// Extract bpm and time signature
-	tsInfo = extractTimeSignatureInfo(mainMIDIFile);
-	originalBpm = tsInfo.bpm;
-
-	// Generate the drum pattern map
-	drumPatterns = getDrumPatterns(tsInfo);
+	trained.tsInfo = extractTimeSignatureInfo(mainMIDIFile);
 
 	// Extract melody
-	processMidiEvents(mainMIDIFile, tsInfo, [&](
+	processMidiEvents(mainMIDIFile, trained.tsInfo, [&](
 		const Note note,
 		const Clock::time_point eventStartTime,
 		const double duration
 	) {
 		const auto event = make_shared<FixedEvent>(
 			note,
-			getMTP(playStartTime, eventStartTime, tsInfo),
+			getMTP(Clock::time_point{}, eventStartTime, trained.tsInfo),
 			duration
 		);
 
-		melody.events.push_back(event);
+		trained.melody.events.push_back(event);
 	});
 
 	KeyDetectionResult result;
-	updateMelodyMetadata(melody, INIT_DEBUG ? &result : nullptr);
+	updateMelodyMetadata(trained.melody, INIT_DEBUG ? &result : nullptr);
 
 	if (INIT_DEBUG) {
-		printTimeSignatureInformation(tsInfo);
-		printMelodyInformation(melody);
+		printTimeSignatureInformation(trained.tsInfo);
+		printMelodyInformation(trained.melody);
 		printKeyDetectionDebug(result);
 		cout << "=============================\n";
 	}
 
 	// Dynamically set tolerance for downbeat detection
-	DOWNBEAT_STRETCH_TOLERANCE = abs(melody.shortestNoteLength - 5);
+	DOWNBEAT_STRETCH_TOLERANCE = abs(trained.melody.shortestNoteLength - 5);
 
 	// Set Markov chain order (a.k.a. lookbehind)
-	const int markovChainOrder = autoMarkov
-		? determineBestOrder(melody, mode)
+	trained.order = autoMarkov
+		? determineBestOrder(trained.melody, mode)
 		: markovOrder;
 
-	// Initialize Markov chain and note buffer for training
-	mm.initMarkovChain(markovChainOrder, melody);
+	trained.chain = MelodyMaker::trainMarkovChain(trained.order, trained.melody);
 
-	// Load logic.lua and bind remaining music functions
-	loadLuaLogic();
+	return trained;
+}
 
-	// Initialize music state
-	onStart();
 
-	if constexpr (!OFFLINE_MODE) {
-		// Start the socket server
-		gb.startGameStateListener();
-		gb.waitForConnection();
+/** Stop receiving and wait for the game state thread, so that it can't outlive the session */
+void MusicMaker::stopGameStateThread() {
+	stopReceiver.store(true);
+	if constexpr (!OFFLINE_MODE) gb.closeGameStateListener();  // Wakes the game state thread
+	if (gameStateThread.joinable()) gameStateThread.join();
+}
 
-		startGameStateThread();
+/** Silence the synth and dump statistics once playback is over */
+void MusicMaker::finish() {
+	stopGameStateThread();
+	midi.stopAll();  // ensure silence on exit
+
+	if (liveInput) {
+		liveInput->close();
+		cout << "[MusicMaker] Trained on " << liveInput->noteCount() << " live notes\n";
 	}
 
-	// Start generating music
-	play();
+	// Dump playback timing statistics
+	const string timingCSV = config.name.empty()
+		? TIMING_CSV
+		: "timing_results_" + config.name + ".csv";
+
+	const HistogramSummary lateness = timingStats.noteLateness.summary();
+	cout << "[MusicMaker] Note lateness over " << lateness.count << " notes: p50 = " << lateness.p50
+		 << " us, p99 = " << lateness.p99 << " us, max = " << lateness.max << " us\n";
+	cout << "[MusicMaker] Generation: " << timingStats.deadlineMisses << " deadline misses, "
+		 << timingStats.degradedMeasures << " measures with fallbacks, "
+		 << timingStats.allocations.dispatch << " allocations while dispatching\n";
+	const HistogramSummary generationAllocs = timingStats.allocations.perGeneration.summary();
+	cout << "[MusicMaker] Heap allocations per measure: p50 = " << generationAllocs.p50
+		 << ", p99 = " << generationAllocs.p99 << ", max = " << generationAllocs.max << "\n";
+	if (const auto* counter = dynamic_cast<const NullSink*>(&midi.getSink()))
+		cout << "[MusicMaker] Output discarded: " << counter->noteOns.load() << " note-ons, " << counter->noteOffs.load() << " note-offs\n";
+	const HistogramSummary voices = timingStats.synth.voices.summary();
+	if (voices.count > 0)
+		cout << "[MusicMaker] Synth voices: p99 = " << voices.p99 << ", max = " << voices.max << ", "
+			 << timingStats.synth.shedMeasures << " measures with shed layers\n";
+	const int64_t loadMs = timingStats.startup.soundfontLoadTime / 1000;
+	const int64_t waitMs = timingStats.startup.soundfontWaitTime / 1000;
+	cout << "[MusicMaker] Startup: prepared in " << timingStats.startup.prepareTime / 1000 << " ms, soundfont loaded in "
+		 << loadMs << " ms, " << max<int64_t>(loadMs - waitMs, 0) << " ms of it hidden behind setup\n";
+	cout << "[MusicMaker] Startup: waited " << timingStats.startup.connectWaitTime / 1000 << " ms for the game, first note "
+		 << timingStats.startup.timeToFirstNote / 1000 << " ms after playback started\n";
+	cout << "[MusicMaker] Theme channels: peak " << channelAllocator.peak() << " of " << channelAllocator.capacity()
+		 << ", " << channelAllocator.failureCount() << " allocation failures\n";
+	if (!timingStats.writeCSV(timingCSV))
+		cerr << "[MusicMaker] Failed to write " << timingCSV << endl;
 
-	midi.stopAll();  // ensure silence on exit
 	isRunning.store(false, memory_order_release);
 }
 
 
+/** Drive playback on the calling thread until it is stopped */
 void MusicMaker::play() {
-	mode = Mode::PLAY;
+	if (config.realTime) enterRealTimeMode();
 
-	double playTime = 0.0;  // Accumulated playing time
-	double mstRel   = 0.0;  // Relative measure start time (relative to playStartTime)
+	Clock::time_point wakeTime;
+	while (true) {
+		const TickResult result = tick(wakeTime);
+		if (result == TickResult::STOPPED) break;
 
-	Chord lastChord{};
+		if (result == TickResult::IDLE)
+			waitWhileIdle();
+		else
+			waitUntil(wakeTime);
+	}
+}
 
-	vector<ScheduledPlaybackEvent> overflowQueue;  // For events that drag over to the next measure
 
-	// Short delay to ensure that the default settings have been replaced
-	this_thread::sleep_for(chrono::milliseconds(150));
+/**
+ * Advance playback without blocking: generate the next measure once the current one is done
+ * and dispatch all events that are due. If more work is pending, `wakeTime` is set to when it is due.
+ */
+MusicMaker::TickResult MusicMaker::tick(Clock::time_point& wakeTime) {
+	// Cooperative stop
+	if (stopRequested.load(memory_order_relaxed)) {
+		cout << "[MusicMaker] Stop requested. Exiting play loop...\n";
+		midi.stopAll();
+		return TickResult::STOPPED;
+	}
 
-	playStartTime = Clock::now();
+	if constexpr (!OFFLINE_MODE) {
+		if (!clientSeen) return TickResult::IDLE;  // Game not connected yet
 
-	// Generate music measure by measure
-	while (true) {
-		// Cooperative stop
-		if (stopRequested.load(memory_order_relaxed)) {
-			cout << "[MusicMaker] Stop requested. Exiting play loop...\n";
-			midi.stopAll();
-			break;
+		if (isPaused) {  // Also while the game is disconnected, until it reconnects
+			scheduler.dropUntil(playhead.measureEnd);  // Discard the rest of the interrupted measure
+			return TickResult::IDLE;
 		}
+	}
 
-		if constexpr (!OFFLINE_MODE) {
-			if (!gb.isClientConnected()) {
-				cout << "[MusicMaker] Stopping music...\n";
-				midi.stopAll();
-				break;
-			}
-			if (isPaused) {
-				this_thread::sleep_for(chrono::milliseconds(10));
-				continue;
+	auto now = Clock::now();
+
+	if (!playhead.started) {
+		// Short delay to ensure that the default settings have been replaced
+		if (playhead.startAt == Clock::time_point{}) {
+			playhead.startAt = now + chrono::milliseconds(150);
+			if (playbackStart == Clock::time_point{}) {
+				playbackStart = now;
+				timingStats.startup.connectWaitTime = microsBetween(prepareEnd, now);
 			}
 		}
+		if (now < playhead.startAt) {
+			wakeTime = playhead.startAt;
+			return TickResult::WAITING;
+		}
 
-		// --- SETUP ---
-		playbackQueue = move(overflowQueue);
-		overflowQueue.clear();
+		mode = liveInput ? Mode::RECORD : Mode::PLAY;  // RECORD: playing while training on live input
+		scheduler.clear();
+		tempoMap.reset(originalBpm * playState.tempoMultiplier);
+		playStartTime = now;
+		playhead.nextGeneration = now;
+		playhead.started = true;
+	}
 
-		// Change tempo
-		currentBpm = originalBpm * musicState.tempoMultiplier;
-		tsInfo.changeTempo(currentBpm);
+	// Generate the next measure ahead of time, so that it is scheduled before the current one ends
+	if (now >= playhead.nextGeneration) {
+		generateMeasure();
+		now = Clock::now();
+	}
 
-		// Timing (after tempo change!)
-		const double metRel = mstRel + tsInfo.msPerMeas;  // relative measure end time
-		const auto mstAbs = playStartTime + doubleToMs(mstRel);  // absolute measure start time
-		const auto metAbs = playStartTime + doubleToMs(metRel);  // absolute measure end time
+	// Play all events that are due in proper order.
+	// Events dragging over into the next measure simply stay queued in the scheduler.
+	// This loop must not allocate, which is verified by counting the thread's allocations.
+	const uint64_t allocationsBefore = threadAllocationCount();
 
+	const Tick nowTick = tempoMap.toTick(microsBetween(playStartTime, now));
 
-		// Generate chords for current scale (i.e. musical mode)
-		generateDiatonicChords(melody.keyRoot, musicState.scale);
+	ScheduledPlaybackEvent evt;
+	while (scheduler.popDue(nowTick, evt))
+		dispatch(evt);
+	playhead.dispatchedTick = nowTick;
 
+	if (const uint64_t allocations = threadAllocationCount() - allocationsBefore; allocations > 0) {
+		timingStats.allocations.dispatch.fetch_add(allocations, memory_order_relaxed);
+		assert(!config.realTime && "Heap allocation in the real-time dispatch loop");
+	}
 
-		// --- GENERATE EVENTS ---
-		// Generate melody events
-		vector<shared_ptr<ScheduledEvent>> schedule;
+	wakeTime = playhead.nextGeneration;
+	if (!scheduler.empty())
+		wakeTime = min(wakeTime, tickToTime(scheduler.top().tick));
+	return TickResult::WAITING;
+}
 
-		while (playTime < metRel) {
-			auto nextEvent = pollNextEventWithTiming(playTime);
-			if (!nextEvent) continue;
 
-			// Clip event duration to fit in measure if the overhang is reasonably small (less than an 16th note)
-			const double remaining = metRel - (playTime - mstRel);
-			if (nextEvent->duration >= remaining && nextEvent->duration < remaining + 0.25 * tsInfo.msPerBeat) {
-				nextEvent->duration = remaining;
-			}
-
-			schedule.push_back(nextEvent);
-			playTime += nextEvent->duration;
+/**
+ * Generate and schedule all events of the next measure.
+ * Generation has to finish before the measure starts. Once GENERATION_BUDGET is used up, the remaining steps
+ * fall back to cheaper variants: the last chord is repeated, theme windows are reused from the cache
+ * and extra melody/chord layers are skipped.
+ */
+void MusicMaker::generateMeasure() {
+	// --- SETUP ---
+	const auto generationStart = Clock::now();
+	const uint64_t allocationsBefore = threadAllocationCount();
+
+	generationArena.release();  // Scratch data of the previous measure
+
+	// Continue the melody with the latest live-trained chain
+	if (liveInput) {
+		if (auto chain = liveInput->latestChain(); chain && chain != liveChain) {
+			liveChain = chain;
+			mm.useChain(move(chain));
 		}
+	}
+	const auto budgetEnd = generationStart + GENERATION_BUDGET;
+	bool degraded = false;
+
+	auto overBudget = [&] {
+		if (Clock::now() < budgetEnd) return false;
+		degraded = true;
+		return true;
+	};
+
+	Tick& playTick = playhead.playTick;
+	const Tick measureStart = playhead.measureEnd;
+	Chord& lastChord = playhead.lastChord;
+
+	// Compensate for the time spent paused
+	{
+		lock_guard lock(playbackMutex);
+		playStartTime += pendingPauseShift;
+		pendingPauseShift = {};
+	}
 
+	// Grab the latest music state published by Lua (once per measure)
+	const MusicSnapshot& snapshot = musicSnapshots.read();
+	playState = snapshot.state;
 
-		// Chord detection
-		vector<Note> notesInMeasure;
-		for (const auto& e: schedule)
-			if (!isNoActualNote(e->note))
-				notesInMeasure.push_back(e->note);
-
-		Chord nextChord = notesInMeasure.empty() ? lastChord : getChord(notesInMeasure, musicState.scale);
-
-		playChordTransition(lastChord, nextChord);
-		lastChord = nextChord;
-
-
-		const auto themeStartTime = mstAbs;
-
-		// Add active MIDI themes to the music
-		for (const auto& [path, instrument] : activeThemes) {
-			auto midiFile = getCachedMIDI(path);
-
-			// Fit theme to tempo
-			TimeSignatureInfo themeTs = extractTimeSignatureInfo(midiFile);
-			themeTs.changeTempo(currentBpm);
+	// Shed low-priority layers before the synth runs out of voices or CPU time
+	if (const SynthLoad synthLoad = midi.getLoad(); synthLoad.polyphony > 0) {
+		timingStats.synth.record(synthLoad.cpuLoad, synthLoad.activeVoices, polyphonyGovernor.update(synthLoad));
+		polyphonyGovernor.apply(playState.leadLayers, playState.chordLayers);
+	}
 
-			// Fit theme to chord
-			const KeyDetectionResult kdr = detectKey(midiFile, themeTs);
-			const Note themeKey = kdr.bestKey;
-			fitToChord(midiFile, themeKey, nextChord);
+	// Change tempo (from this measure on, everything already scheduled keeps its musical position)
+	currentBpm = originalBpm * playState.tempoMultiplier;
+	tsInfo.changeTempo(currentBpm);
+	tempoMap.trimBefore(measureStart);
+	tempoMap.setTempo(measureStart, currentBpm);
+
+	// Timing (in ticks, converted to wall time only at dispatch)
+	const Tick measureTicks = tsInfo.num * PPQ;
+	const Tick measureEnd = measureStart + measureTicks;
+
+
+	// Generate chords for current scale (i.e. musical mode)
+	generateDiatonicChords(model->melody.keyRoot, playState.scale);
+
+
+	// --- GENERATE EVENTS ---
+	// Generate melody events
+	pmr::vector<ScheduledEvent> schedule(&generationArena);
+
+	// The steps are mapped lazily as they are read, the rest of the stream is left for the next measure
+	const Note keyRoot = model->melody.keyRoot;
+	const Scale scale = playState.scale;
+	auto melody = mm.events()
+		| views::transform([keyRoot, scale](const MelodyStep& step) {
+			// Adjust note based on current musical mode (church scale)
+			return MelodyStep{changeNoteForScale(step.note, keyRoot, scale, scale), step.duration};
+		})
+		| views::transform([bpm = originalBpm](const MelodyStep& step) {
+			// Trained durations are µs at the input's tempo, on the timeline they are tempo independent
+			return pair{step.note, static_cast<Tick>(llround(step.duration * PPQ * bpm / 60e6))};
+		});
+
+	for (auto it = melody.begin(); playTick < measureEnd; ++it) {
+		auto [note, duration] = *it;
+
+		// Clip event duration to fit in measure if the overhang is reasonably small (less than an 16th note)
+		const Tick remaining = measureEnd - playTick;
+		if (duration >= remaining && duration < remaining + PPQ / 4) {
+			duration = remaining;
+		}
 
-			auto &[msOffset] = themePlaybackStates[path];  // Per-theme playhead tracker
-			const double themeLengthMs = midiFile.getFileDurationInTicks() * themeTs.msPerTick;
+		schedule.emplace_back(note, playTick, duration);
+		playTick += max<Tick>(duration, 1);
+	}
 
-			processMidiEvents(midiFile, themeTs, [&]<typename T>(const T& noteOrPause, const Clock::time_point eventTimeRaw, double durationMs) {
-				// Get time since the start of this theme parse
-				const auto eventTime = themeStartTime + (eventTimeRaw - Clock::time_point{});  // realign to current measure
-				const double localMs = chrono::duration<double, micro>(eventTime - themeStartTime).count();
 
-				double loopedMs = fmod(localMs, themeLengthMs);
-				if (loopedMs < 0.0)
-					loopedMs += themeLengthMs;
+	// Chord detection
+	pmr::vector<Note> notesInMeasure(&generationArena);
+	for (const auto& e: schedule)
+		if (!isNoActualNote(e.note))
+			notesInMeasure.push_back(e.note);
 
-				if (loopedMs < msOffset || loopedMs >= msOffset + tsInfo.msPerMeas)
-					return;
+	// Fallback: Keep the last chord instead of scoring a new one.
+	// Explicit branches, so that nextChord is lastChord itself in the fallback and the copy below is skipped
+	const Chord* chosenChord = &lastChord;
+	if (!notesInMeasure.empty() && !overBudget())
+		chosenChord = &getChord(notesInMeasure, playState.scale, &generationArena);
+	const Chord& nextChord = *chosenChord;
 
-				const double offsetWithinWindow = loopedMs - msOffset;
-				const auto scheduledTime = themeStartTime + doubleToMs(offsetWithinWindow);
+	// Fallback: Skip extra layers
+	if (overBudget()) {
+		playState.leadLayers  = 1;
+		playState.chordLayers = 1;
+	}
 
-				if constexpr (is_same_v<T, Note>) {
-					scheduleNote(noteOrPause, scheduledTime, durationMs, instrument);
-				}
-			});
+	playChordTransition(lastChord, nextChord, measureStart);
+	if (&nextChord != &lastChord)
+		lastChord = nextChord;  // Reuses lastChord's string/vector capacity
 
-			// Advance theme playhead
-			msOffset += tsInfo.msPerMeas;
 
-			// Wrap around if needed
-			if (msOffset >= themeLengthMs)
-				msOffset = fmod(msOffset, themeLengthMs);
+	// Forget the playheads of themes that were deactivated
+	erase_if(themePlaybackStates, [&](const auto& entry) {
+		return ranges::none_of(snapshot.themes, [&](const auto& theme) { return theme.first == entry.first; });
+	});
+	recycleThemeChannels(snapshot);
+
+	// Add active MIDI themes to the music
+	for (const auto& [path, instrument] : snapshot.themes) {
+		ThemePlaybackState& state = themePlaybackStates[path];  // Per-theme playhead tracker
+		if (!state.theme) state.theme = resources->getTheme(path);
+		if (!state.theme) continue;
+
+		const ThemeInfo& theme = *state.theme;
+		Tick& offset = state.offset;
+
+		// Themes are laid out on the timeline by their beats, so they follow the tempo automatically
+		const Tick themeLength = theme.length;
+		if (themeLength <= 0) continue;
+
+		const auto windowIdx = static_cast<size_t>(offset / measureTicks);
+		if (state.windows.size() <= windowIdx)
+			state.windows.resize(windowIdx + 1);
+		auto& window = state.windows[windowIdx];
+
+		// Fallback: Reuse the cached window (possibly fitted to an earlier chord)
+		if (window.empty() || !overBudget()) {
+			window.clear();
+
+			for (const auto& [noteTick, note, duration] : theme.notes) {
+				const Tick loopedTick = noteTick % themeLength;
+				if (loopedTick < offset || loopedTick >= offset + measureTicks)
+					continue;
+
+				// Fit theme to chord
+				const auto fitted = static_cast<Note>(fitNoteToChord(note, theme.key, nextChord));
+				window.push_back({loopedTick - offset, fitted, duration});
+			}
 		}
 
+		for (const auto& [noteOffset, note, duration] : window)
+			scheduleNote(note, measureStart + noteOffset, duration, instrument);
 
-		// --- SCHEDULE MIDI EVENTS ---
-		scheduleMelody(schedule);
-
-		scheduleBass(nextChord, mstAbs);
-
-		scheduleDrums(mstAbs);
+		// Advance theme playhead (wrapping around at the end of the theme)
+		offset = (offset + measureTicks) % themeLength;
+	}
 
 
-		// --- PLAY EVENTS ---
-		// Filter playbackQueue to only current measure
-		vector<ScheduledPlaybackEvent> currentMeasureEvents;
-		for (const auto& evt: playbackQueue) {
-			if (evt.startTime <= metAbs)
-				currentMeasureEvents.push_back(evt);
-			else
-				overflowQueue.push_back(evt);
-		}
+	// --- SCHEDULE MIDI EVENTS ---
+	scheduleMelody(schedule);
 
+	scheduleBass(nextChord, measureStart);
 
-		// Play the events in proper order
-		ranges::sort(currentMeasureEvents, {}, &ScheduledPlaybackEvent::startTime);
-		for (const auto& [time, note, channel, velocity, isNoteOn]: currentMeasureEvents) {
-			this_thread::sleep_until(time);
+	scheduleDrums(measureStart);
 
-			// ReSharper disable once CppDFAConstantConditions
-			// ReSharper disable once CppDFAUnreachableCode
-			if (isPaused)
-				break;
+	// Advance to the next measure
+	playhead.measureEnd = measureEnd;
+	playhead.nextGeneration = tickToTime(measureEnd) - GENERATION_BUDGET;
 
-			if (isNoteOn)
-				midi.playNote(note, channel, velocity);
-			else
-				midi.stopNote(note, channel);
-		}
-
-		mstRel += tsInfo.msPerMeas;
-	}
+	const auto generationEnd = Clock::now();
+	timingStats.recordGeneration(microsBetween(generationStart, generationEnd), tsInfo.msPerMeas);
+	timingStats.recordGenerationOutcome(degraded, generationEnd > tickToTime(measureStart));
+	timingStats.allocations.perGeneration.record(static_cast<int64_t>(threadAllocationCount() - allocationsBefore));
 }
 
+/** Wall time of a timeline tick (for the current tempo map and pause compensation) */
+Clock::time_point MusicMaker::tickToTime(const Tick tick) const {
+	return playStartTime + chrono::microseconds(tempoMap.toMicros(tick));
+}
 
-/** Get the next melody event from the MelodyMaker's Markov model and adjust its timing */
-shared_ptr<ScheduledEvent> MusicMaker::pollNextEventWithTiming(const double melodyTime) {
-	const auto event = mm.pollNextEvent();
-
-	// Skip START tokens
-	const auto full = dynamic_pointer_cast<FixedEvent>(event);
-	if (!full) return {};
-
-	// Adjust note based on current musical mode (church scale)
-	Note note = changeNoteForScale(full->note, melody.keyRoot, musicState.scale, musicState.scale);
-
-	// Compute initial target time
-	auto targetTime = playStartTime + doubleToMs(melodyTime);
+void MusicMaker::dispatch(const ScheduledPlaybackEvent& evt) {
+	if (evt.isNoteOn) {
+		if (channelRetiring[evt.channel]) return;  // Left over from a deactivated theme
 
-	// Scale duration based on dynamic tempo
-	double duration = full->duration * (originalBpm / tsInfo.bpm);
+		const auto now = Clock::now();
+		timingStats.recordNoteLateness(evt.channel, microsBetween(tickToTime(evt.tick), now));
+		midi.playNote(evt.note, evt.channel, evt.velocity);
 
-	return make_shared<ScheduledEvent>(
-		note,
-		targetTime,
-		duration
-	);
+		if (firstNoteTime == Clock::time_point{}) {
+			firstNoteTime = now;
+			timingStats.startup.timeToFirstNote = microsBetween(playbackStart, now);
+		}
+	} else {
+		midi.stopNote(evt.note, evt.channel);
+	}
 }
 
 
 /** Schedule a single note on-off pair */
 void MusicMaker::scheduleNote(
 	const Note note,
-	const Clock::time_point startTime,
-	const double duration,
+	const Tick start,
+	const Tick duration,
 	const ActiveInstrument instrument
 ) {
-	playbackQueue.emplace_back(startTime, note, instrument.channel, instrument.velocity, true);
-	playbackQueue.emplace_back(startTime + doubleToMs(duration), note, instrument.channel, instrument.velocity, false);
+	scheduler.push({start, note, instrument.channel, instrument.velocity, true});
+	scheduler.push({start + duration, note, instrument.channel, instrument.velocity, false});
+	lastScheduledTick[instrument.channel] = max(lastScheduledTick[instrument.channel], start + duration);
+}
+
+
+/**
+ * Quarantine the channels of deactivated themes: they are silenced right away and their pending note-ons dropped,
+ * but they only go back to the allocator once every event scheduled on them has been dispatched
+ * and the snapshot no longer lists them. Otherwise a new theme could get the channel while old events still play on it.
+ */
+void MusicMaker::recycleThemeChannels(const MusicSnapshot& snapshot) {
+	channelAllocator.takeRetired([this](const int channel) {
+		channelRetiring[channel] = true;
+		midi.stopChannel(channel);
+		retiringChannels.push_back(channel);
+	});
+
+	erase_if(retiringChannels, [&](const int channel) {
+		const bool inSnapshot = ranges::any_of(snapshot.themes, [&](const auto& theme) { return theme.second.channel == channel; });
+		if (inSnapshot || lastScheduledTick[channel] > playhead.dispatchedTick) return false;
+
+		channelRetiring[channel] = false;
+		channelAllocator.release(channel);
+		return true;
+	});
 }
 
 /** Schedule melody note events for one measure */
-void MusicMaker::scheduleMelody(const vector<shared_ptr<ScheduledEvent>>& schedule) {
+void MusicMaker::scheduleMelody(const span<const ScheduledEvent> schedule) {
+	const auto& [durationFactor, restAfterNote] = getLeadStyleParams(playState.leadStyle);
+
 	for (const auto& e: schedule) {
-		if (isNoActualNote(e->note))
+		if (isNoActualNote(e.note))
 			continue;
 
 		// Shorten duration if intensity is high
-		const double duration = musicState.leadStyle == "Pulse" ? e->duration * 0.5 : e->duration;
+		const auto duration = static_cast<Tick>(llround(static_cast<double>(e.duration) * durationFactor));
 
 		// Schedule base note
-		scheduleNote(e->note, e->startTime, duration, LEAD);
+		scheduleNote(e.note, e.start, duration, LEAD);
 
 		// Add a pause after short notes if staccato
-		if (musicState.leadStyle == "Pulse")
-			scheduleNote(PAUSE, e->startTime + doubleToMs(duration), duration, LEAD);
+		if (restAfterNote)
+			scheduleNote(PAUSE, e.start + duration, duration, LEAD);
 
 		// Schedule melody layers
-		for (int i = 2; e->note + (i - 1) * 12 < 128; ++i)
-			if (musicState.leadLayers >= i)
-				scheduleNote(e->note + (i - 1) * 12, e->startTime, duration, LEAD);
+		for (int i = 2; e.note + (i - 1) * 12 < 128; ++i)
+			if (playState.leadLayers >= i)
+				scheduleNote(e.note + (i - 1) * 12, e.start, duration, LEAD);
 	}
 }
 
+
+// Bass generators, indexed by BassStyle
+const array<MusicMaker::BassGenerator, NUM_BASS_STYLES> MusicMaker::bassGenerators = {
+	&MusicMaker::scheduleBassSustain,  // SUSTAIN
+	&MusicMaker::scheduleBassPulse,    // PULSE
+	&MusicMaker::scheduleBassFast      // FAST
+};
+
 /** Schedule bass notes for one measure */
-void MusicMaker::scheduleBass(const Chord& nextChord, const Clock::time_point mstAbs) {
-	const Note root = nextChord.root;
+void MusicMaker::scheduleBass(const Chord& nextChord, const Tick measureStart) {
+	(this->*bassGenerators[static_cast<size_t>(playState.bassStyle)])(nextChord.root, measureStart);
+}
 
-	if (musicState.bassStyle == "Sustain") {
-		const Note bassNote = root == 0 ? root + 36 : root + 24; // higher bass
-		scheduleNote(bassNote, mstAbs, tsInfo.msPerMeas, BASS);
+void MusicMaker::scheduleBassSustain(const Note root, const Tick measureStart) {
+	const Note bassNote = root == 0 ? root + 36 : root + 24; // higher bass
+	scheduleNote(bassNote, measureStart, tsInfo.num * PPQ, BASS);
+}
 
-	} else {
-		const Note bassNote = root == 11 ? root + 12 : root + 24; // lower bass
+void MusicMaker::scheduleBassPulse(const Note root, const Tick measureStart) {
+	const Note bassNote = root == 11 ? root + 12 : root + 24; // lower bass
+	constexpr Tick pulseDuration = PPQ * 6 / 10;
 
-		if (musicState.bassStyle == "Pulse") {
-			const double pulseDuration = tsInfo.msPerBeat * 0.6;
+	for (int i = 0; i < tsInfo.num; ++i) {
+		const Tick pulseStart = measureStart + i * PPQ;
+		scheduleNote(bassNote, pulseStart, pulseDuration, BASS);
+	}
+}
 
-			for (int i = 0; i < tsInfo.num; ++i) {
-				const auto pulseStart= mstAbs + doubleToMs(i * tsInfo.msPerBeat);
-				scheduleNote(bassNote, pulseStart, pulseDuration, BASS);
-			}
-		} else if (musicState.bassStyle == "Fast") {
-			const double pulseDuration = tsInfo.msPerBeat * 0.15;
-
-			for (int i = 0; i < tsInfo.num * 4; ++i) {
-				const auto pulseStart= mstAbs + doubleToMs(static_cast<double>(i) * 0.25 * tsInfo.msPerBeat);
-				scheduleNote(
-					(i - 2) % 4 == 0 ? bassNote + 12 : bassNote,  // octave up on every offbeat
-					pulseStart,
-					pulseDuration,
-					BASS
-				);
-			}
-		}
+void MusicMaker::scheduleBassFast(const Note root, const Tick measureStart) {
+	const Note bassNote = root == 11 ? root + 12 : root + 24; // lower bass
+	constexpr Tick pulseDuration = PPQ * 15 / 100;
+
+	for (int i = 0; i < tsInfo.num * 4; ++i) {
+		const Tick pulseStart = measureStart + i * PPQ / 4;
+		scheduleNote(
+			(i - 2) % 4 == 0 ? bassNote + 12 : bassNote,  // octave up on every offbeat
+			pulseStart,
+			pulseDuration,
+			BASS
+		);
 	}
 }
 
 /** Schedule drum groove for one measure */
-void MusicMaker::scheduleDrums(const Clock::time_point mstAbs) {
-	if (const auto it = drumPatterns.find(musicState.drumPattern); it != drumPatterns.end()) {
-		for (const auto& [note, beatOffsets]: it->second) {
-			for (const double i: beatOffsets) {
-				const auto pulseStart= mstAbs + doubleToMs(i * tsInfo.msPerBeat);
-				scheduleNote(note, pulseStart, 0, DRUMS);
-			}
-		}
-	} else {
-		cerr << "[MusicMaker] Unknown drum_pattern: " << static_cast<int>(musicState.drumPattern) << endl;
+void MusicMaker::scheduleDrums(const Tick measureStart) {
+	const auto& pattern = drumPatterns[static_cast<size_t>(playState.drumPattern)];
+
+	const auto& hits = pattern.getHits();
+	const auto& offsets = pattern.getOffsets();
+
+	for (size_t i = 0; i < hits.size(); ++i) {
+		const ActiveInstrument drums{DRUMS.channel, DRUMS.program, hits[i].velocity};
+		scheduleNote(hits[i].note, measureStart + offsets[i], 0, drums);
 	}
 }
 
 
 /**
  * When changing chords, make sure that only new notes are being triggered,
- * and common notes between old and new chord are simply held through
+ * and common notes between old and new chord are simply held through.
+ * The transition is scheduled for the start of the measure.
  */
-void MusicMaker::playChordTransition(const Chord& lastChord, const Chord& nextChord) {
-	vector<Note> lastChordNotes;
+void MusicMaker::playChordTransition(const Chord& lastChord, const Chord& nextChord, const Tick measureStart) {
+	pmr::vector<Note> lastChordNotes(&generationArena);
 	for (const int interval : lastChord.type.intervals)
 		lastChordNotes.emplace_back((lastChord.root + interval) % 12);
 
-	vector<Note> nextChordNotes;
+	pmr::vector<Note> nextChordNotes(&generationArena);
 	for (const int interval : nextChord.type.intervals)
 		nextChordNotes.emplace_back((nextChord.root + interval) % 12);
 
@@ -399,43 +681,112 @@ void MusicMaker::playChordTransition(const Chord& lastChord, const Chord& nextCh
 	// Stop notes no longer in the chord
 	for (const auto& note : lastChordNotes) {
 		if (forceRetrigger || !ranges::contains(nextChordNotes, note))
-			midi.stopNote(note + 60, CHORDS.channel);
+			scheduler.push({measureStart, static_cast<Note>(note + 60), CHORDS.channel, CHORDS.velocity, false});
 
 		// Always stop upper layers
 		for (int i = 2; note + (i + 4) * 12 < 128; ++i)
-			midi.stopNote(note + (i + 4) * 12, CHORDS.channel);
+			scheduler.push({measureStart, static_cast<Note>(note + (i + 4) * 12), CHORDS.channel, CHORDS.velocity, false});
 	}
 
 	// Play new notes or retrigger on resume
 	for (const auto& note : nextChordNotes) {
 		if (forceRetrigger || !ranges::contains(lastChordNotes, note))
-			midi.playNote(note + 60, CHORDS.channel, CHORDS.velocity);
+			scheduler.push({measureStart, static_cast<Note>(note + 60), CHORDS.channel, CHORDS.velocity, true});
 
 		// Play chord layers
 		for (int i = 2; note + (i + 4) * 12 < 128; ++i)
-			if (musicState.chordLayers >= i)
-				midi.playNote(note + (i + 4) * 12, CHORDS.channel, CHORDS.velocity);
+			if (playState.chordLayers >= i)
+				scheduler.push({measureStart, static_cast<Note>(note + (i + 4) * 12), CHORDS.channel, CHORDS.velocity, true});
+	}
+}
+
+
+void MusicMaker::requestStop() {
+	{
+		lock_guard lock(playbackMutex);
+		stopRequested.store(true, memory_order_relaxed);
 	}
+	wakePlayback();
+}
+
+/** Wake up the play loop (or the session host) so it re-evaluates its pause/stop/connection state */
+void MusicMaker::wakePlayback() {
+	{
+		lock_guard lock(playbackMutex);
+	}
+	playbackCV.notify_all();
+	if (wakeCallback) wakeCallback();
 }
 
 
 void MusicMaker::pause() {
-	if (isPaused) return;
-	isPaused = true;
+	{
+		lock_guard lock(playbackMutex);
+		if (isPaused) return;
+		isPaused = true;
+		pauseTime = Clock::now();
+	}
+	wakePlayback();  // Interrupt the event currently waited for
 
 	cout << "[MusicMaker] Game paused. Stopping music...\n";
 	midi.stopAll();
-
-	pauseTime = Clock::now();
 }
 
 void MusicMaker::resume() {
-	// Compensate for the pause duration
-	const auto resumeTime = Clock::now();
-	const auto pauseDuration = resumeTime - pauseTime;
-	playStartTime += pauseDuration;
-
-	wasJustResumed = true;
+	{
+		lock_guard lock(playbackMutex);
+		if (!isPaused) return;
+		isPaused = false;
+
+		// Compensate for the pause duration (applied by the play loop at the next measure start)
+		pendingPauseShift += Clock::now() - pauseTime;
+		wasJustResumed = true;
+	}
+	wakePlayback();
 
 	cout << "[MusicMaker] Game resumed.\n";
 }
+
+/** Block the play loop without polling until there is something to play again (or to stop) */
+void MusicMaker::waitWhileIdle() {
+	unique_lock lock(playbackMutex);
+	playbackCV.wait(lock, [this] {
+		return stopRequested.load(memory_order_relaxed)
+			|| (clientSeen && !isPaused);
+	});
+}
+
+/**
+ * Sleep until the given time, or until interrupted by a pause or stop request.
+ * The condition variable wait is the coarse sleep of preciseSleepUntil(), so only the final `spinWindow` is spun.
+ */
+void MusicMaker::waitUntil(const Clock::time_point time) {
+	const bool sleeps = time - config.spinWindow > Clock::now();
+
+	const auto coarseWake = preciseSleepUntil(time, [this](const Clock::time_point until) {
+		unique_lock lock(playbackMutex);
+		return playbackCV.wait_until(lock, until, [this] {
+			return isPaused || stopRequested.load(memory_order_relaxed);
+		});
+	}, config.spinWindow);
+
+	if (coarseWake && sleeps) recordWake(time, *coarseWake);
+}
+
+/** Lock the memory the play loop touches: the generation arena and the scheduler's reserved storage */
+void MusicMaker::lockPlaybackMemory() {
+	bool locked = true;
+	auto lock = [&](const void* data, const size_t bytes) {
+		if (lockMemory(data, bytes)) lockedMemory.emplace_back(data, bytes);
+		else locked = false;
+	};
+	lock(generationArenaBuffer.data(), generationArenaBuffer.size());
+	scheduler.forEachBuffer(lock);
+
+	if (!locked) cerr << "[MusicMaker] Failed to lock the playback memory (RLIMIT_MEMLOCK?)\n";
+}
+
+/** Record how late the coarse sleep before `time` woke up, and how late the wait ended (call right after it) */
+void MusicMaker::recordWake(const Clock::time_point time, const Clock::time_point coarseWake) {
+	timingStats.wake.record(microsBetween(time - config.spinWindow, coarseWake), microsBetween(time, Clock::now()));
+}
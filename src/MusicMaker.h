@@ -10,10 +10,24 @@
 #include "algo/ChordDetector.h"
 #include "algo/KeyDetector.h"
 
+#include "data/ChannelAllocator.h"
 #include "data/DrumPattern.h"
 #include "data/Instrument.h"
+#include "data/PlaybackScheduler.h"
+#include "data/Style.h"
+
+#include "engine/SharedResources.h"
 
 #include "game/GameBridge.h"
+#include "game/GameStateProtocol.h"
+
+#include "input/LiveMIDIInput.h"
+
+#include "output/PolyphonyGovernor.h"
+
+#include "util/RealTime.h"
+#include "util/TimingStats.h"
+#include "util/TripleBuffer.h"
 
 
 // Wraps all variable parts of the music generation into one object
@@ -21,29 +35,84 @@ struct MusicState {
 	double intensity		= 0.0;
 	Scale scale				= Scale::IONIAN;
 	double tempoMultiplier	= 1.0;
-	std::string leadStyle	= "Sustain";
+	LeadStyle leadStyle		= LeadStyle::SUSTAIN;
 	int leadLayers			= 1;
 	int chordLayers			= 1;
-	std::string bassStyle	= "Sustain";
+	BassStyle bassStyle		= BassStyle::SUSTAIN;
 	DrumPattern drumPattern	= DrumPattern::NONE;
 };
 
+// Immutable view of the music state handed from the Lua side to the play loop
+struct MusicSnapshot {
+	MusicState state;
+	std::vector<std::pair<std::string, ActiveInstrument>> themes;  // path -> instrument
+};
+
 struct ThemePlaybackState {
-	double msOffset = 0.0;
+	Tick offset = 0;  // Position within the theme on the timeline
+	std::shared_ptr<const ThemeInfo> theme;  // Compiled once, shared between sessions
+
+	std::vector<std::vector<ThemeNote>> windows;  // Last fitted notes per measure-long window, reused when generation runs late
+};
+
+// Where a session's notes go (see output/)
+enum class OutputType {
+	FLUIDSYNTH,	// Live synthesis
+	NONE,		// Only counted, for measuring generation alone
+	SMF			// Captured into a MIDI file
+};
+
+// Per-session settings, so that several sessions can run side by side in one process
+struct SessionConfig {
+	std::string name;							// Tells the output files of sessions apart
+	unsigned short port		= 5555;				// GameBridge port
+	std::string rulesPath	= "lua/rules.lua";
+	std::string logicPath	= "lua/logic.lua";
+	bool realTime			= false;			// Real-time priority and locked playback memory (see util/RealTime.h)
+	Clock::duration spinWindow = DEFAULT_SPIN_WINDOW;	// Final part of each wait that is spun instead of slept (0 = sleep only)
+	OutputType output		= OutputType::FLUIDSYNTH;
+	std::string outputPath;						// MIDI file for OutputType::SMF (derived from the name if empty)
+	std::string recordPath;						// Additionally stream the output into this MIDI file (empty = off)
+	int liveInputPort		= -1;				// Keep training on what is played on this MIDI input port (-1 = off)
+	SynthSettings synth;						// Defaults for music.set_synth() in Lua
 };
 
 
 class MusicMaker {
 public:
-	MusicMaker() = default;
+	explicit MusicMaker(
+		SessionConfig config = {},
+		std::shared_ptr<SharedResources> resources = std::make_shared<SharedResources>()
+	);
+	~MusicMaker();
+
+	void start();  // prepare(), play() and finish() on the calling thread
 
-	void start();
+	// Split playback for hosts driving many sessions from a worker pool (see SessionHost)
+	enum class TickResult {
+		WAITING,	// Call tick() again at the returned wake time
+		IDLE,		// Nothing to do until woken up (paused or not connected yet)
+		STOPPED		// Playback is over, call finish()
+	};
+	void prepare();
+	TickResult tick(Clock::time_point& wakeTime);
+	void finish();
 
-	void requestStop() { stopRequested.store(true, std::memory_order_relaxed); }
+	/** Called (outside of any MusicMaker lock) whenever playback should be re-evaluated: pause, resume, stop, connect */
+	void setWakeCallback(std::function<void()> callback) { wakeCallback = std::move(callback); }
+
+	void requestStop();
 	bool running() const { return isRunning.load(std::memory_order_acquire); }
 
+	const SessionConfig& getConfig() const { return config; }  // realTime and spinWindow also apply to tick() hosts
+	void recordWake(Clock::time_point time, Clock::time_point coarseWake);
+
 	void startPT(const std::string &file);  // For performance testing
 
+	// Playback timing instrumentation (safe to query while running)
+	const TimingStats& getTimingStats() const { return timingStats; }
+	const ChannelAllocator& getChannelAllocator() const { return channelAllocator; }
+
 private:
 	// FUNCTIONS
 	// Lua
@@ -52,41 +121,65 @@ private:
 	void loadLuaLogic();
 	void loadLuaFileSafe(const std::string &path, const char *tag);
 	void validateAllRules();
+	void publishMusicState();
 
 	// GameState
 	void startGameStateThread();
+	void stopGameStateThread();
 	void handleGameState(nlohmann::json& parsed, sol::table& gameState);
+	void handleGameState(const GameStateProtocol::GameState& state, const GameData& game, sol::table& gameState);
 
 	// MIDI
 	void preloadMIDIFile(const std::string &path);
-	smf::MidiFile getCachedMIDI(const std::string& path) const;
-	int getNextAvailableChannel();
+	std::shared_ptr<const smf::MidiFile> getCachedMIDI(const std::string& path) const;
 	void activateMIDITheme(const std::string& path, int program);
 	void deactivateMIDITheme(const std::string &path);
 
-	// Events
-	std::shared_ptr<ScheduledEvent> pollNextEventWithTiming(double melodyTime);
+	// Melody generation
+	TrainedModel trainModel() const;
 
 	void play();
+	void generateMeasure();
+	void dispatch(const ScheduledPlaybackEvent& evt);
+	Clock::time_point tickToTime(Tick tick) const;
+
 	void pause();
 	void resume();
+	void waitWhileIdle();
+	void waitUntil(Clock::time_point time);
+	void wakePlayback();
 
 	std::atomic<bool> stopRequested{false};
 	std::atomic<bool> isRunning{false};
 
-	void scheduleNote(Note note, Clock::time_point startTime, double duration, ActiveInstrument instrument);
-	void scheduleMelody(const std::vector<std::shared_ptr<ScheduledEvent>> &schedule);
-	void scheduleBass(const Chord& nextChord, Clock::time_point mstAbs);
-	void scheduleDrums(Clock::time_point mstAbs);
-	void playChordTransition(const Chord &lastChord, const Chord &nextChord);
+	using BassGenerator = void (MusicMaker::*)(Note root, Tick measureStart);
+	static const std::array<BassGenerator, NUM_BASS_STYLES> bassGenerators;
+
+	void scheduleNote(Note note, Tick start, Tick duration, ActiveInstrument instrument);
+	void scheduleMelody(std::span<const ScheduledEvent> schedule);
+	void scheduleBass(const Chord& nextChord, Tick measureStart);
+	void scheduleBassSustain(Note root, Tick measureStart);
+	void scheduleBassPulse(Note root, Tick measureStart);
+	void scheduleBassFast(Note root, Tick measureStart);
+	void scheduleDrums(Tick measureStart);
+	void playChordTransition(const Chord &lastChord, const Chord &nextChord, Tick measureStart);
+	void recycleThemeChannels(const MusicSnapshot& snapshot);
+	void lockPlaybackMemory();
 
 	// VARIABLES
+	// Session
+	SessionConfig config;
+	std::shared_ptr<SharedResources> resources;  // Declared before midi: the shared soundfonts must outlive the synth
+	std::function<void()> wakeCallback;
+
 	// Game
 	GameBridge gb;
+	std::atomic<bool> clientSeen{false};  // Set once the game connected
 
 	std::mutex gameStateMutex;
 	std::optional<nlohmann::json> currentGameState;
 	std::atomic<bool> stopReceiver{false};
+	std::thread gameStateThread;  // Joined by stopGameStateThread(): it uses the Lua state and the wake callback
 
 	sol::state lua;
 	sol::function onStart, onUpdate;
@@ -97,33 +190,72 @@ private:
 	Mode mode = Mode::IDLE;
 
 	// Music state
-	MusicState musicState;
+	MusicState musicState;                       // Written by the Lua setters only
+	TripleBuffer<MusicSnapshot> musicSnapshots;  // Lock-free Lua -> play loop handoff
+	MusicState playState;                        // Snapshot used by the play loop for the current measure
 
 	// MIDI
 	std::string mainMIDIFilePath;
-	std::unordered_map<std::string, smf::MidiFile> preloadedMIDICache;
-	std::unordered_map<std::string, ActiveInstrument> activeThemes;
-	std::unordered_map<std::string, ThemePlaybackState> themePlaybackStates;
+	std::unordered_map<std::string, ActiveInstrument> activeThemes;  // Written by Lua only
+	ChannelAllocator channelAllocator;								 // Theme channels: allocated and retired by Lua
+	std::unordered_map<std::string, ThemePlaybackState> themePlaybackStates;  // Play loop only, pruned when a theme is removed
 
 	// Melody generation
-	Melody melody{};  // Input melody provided by the user
+	std::shared_ptr<const TrainedModel> model;  // Input melody provided by the user and the chain trained on it
+	std::unique_ptr<LiveMIDIInput> liveInput;	// Trains a copy of the chain further while playing (optional)
+	std::shared_ptr<const MarkovChain> liveChain;  // Snapshot of it that the melody is currently generated from
 	int markovOrder{};
 	bool autoMarkov{};
 
 	// Playback
-	std::vector<ScheduledPlaybackEvent> playbackQueue;
+	struct Playhead {
+		Tick playTick	= 0;				// End of the generated melody
+		Tick measureEnd = 0;				// End of the last generated measure = start of the next one
+		Clock::time_point nextGeneration;	// When to generate the next measure
+		bool started	 = false;
+		Clock::time_point startAt;		// End of the start delay
+		Chord lastChord{};
+		Tick dispatchedTick = 0;			// Every event up to here has been dispatched
+	} playhead;
+
+	// Retired theme channels: their note-ons are dropped until every event scheduled on them has passed (play loop only)
+	std::array<bool, MIDI_CHANNELS> channelRetiring{};
+	std::array<Tick, MIDI_CHANNELS> lastScheduledTick{};
+	std::vector<int> retiringChannels;
+
+	PlaybackScheduler scheduler;  // Persistent across measures
+	PolyphonyGovernor polyphonyGovernor;  // Sheds layers while the synth is overloaded
+
+	// Scratch memory for generating one measure, released at the start of the next
+	static constexpr size_t GENERATION_ARENA_BYTES = 64 * 1024;
+	std::array<std::byte, GENERATION_ARENA_BYTES> generationArenaBuffer;
+	std::pmr::monotonic_buffer_resource generationArena{generationArenaBuffer.data(), generationArenaBuffer.size()};
+	std::vector<std::pair<const void*, size_t>> lockedMemory;  // Real-time mode, unlocked on destruction
+
+	TempoMap tempoMap;			  // Timeline ticks -> µs since playStartTime
 	Clock::time_point playStartTime;
 	Clock::time_point pauseTime;
+	Clock::duration pendingPauseShift{};  // Accumulated pause time not yet applied to playStartTime
 	std::atomic<bool> isPaused{false};
 	std::atomic<bool> wasJustResumed{false};
 
-	// Live recording
-	std::atomic<bool> isFirstNote{true};
+	// Pause/resume/stop transitions are signaled to the play loop through this condition variable
+	std::mutex playbackMutex;
+	std::condition_variable playbackCV;
 
 	// Timing
 	TimeSignatureInfo tsInfo;
 	double originalBpm = 0.0;
 	double currentBpm = originalBpm;
 
-	std::unordered_map<DrumPattern, Pattern> drumPatterns;
+	DrumPatternLibrary drumPatternLibrary;  // Definitions per meter (built-in + Lua-defined)
+	DrumPatternSet drumPatterns;			// Compiled for the current meter
+	bool drumPatternsCompiled = false;		// Later definitions can't reach the play loop anymore
+
+	// Instrumentation
+	TimingStats timingStats;
+	Clock::time_point prepareStart;
+	Clock::time_point prepareEnd;
+	Clock::time_point playbackStart;  // Unset until playback could start (the game connected)
+	Clock::time_point firstNoteTime;  // Unset until the first note has been played
 };
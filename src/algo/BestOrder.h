@@ -22,7 +22,7 @@ inline std::vector<Melody> generateMelodySamples(
 		Melody generated;
 
 		for (size_t j = 0; j < length; ++j) {
-			auto result= mc.getNext(genBuffer.getSnapshot());
+			auto result= mc.getNext(genBuffer.view());
 			if (!result.has_value()) break;
 
 			const auto& next = *result;
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "../data/MarkovChain.h"  // gen
 #include "../data/Scale.h"
 
 #include <bits/ranges_algo.h>
+#include <memory_resource>
+#include <optional>
+#include <span>
 
 struct ChordType {
 	std::string quality;
@@ -50,9 +54,14 @@ inline std::string basicQuality(const Chord& chord) {
 }
 
 
-inline std::vector<Chord> diatonicChords{};
+inline thread_local std::vector<Chord> diatonicChords{};  // Per thread, regenerated by each session before use
+inline thread_local std::optional<std::pair<Note, Scale>> diatonicChordsFor;  // Key and mode of diatonicChords
 
 inline void generateDiatonicChords(const Note key, const Scale mode) {
+	// Only rebuild (and allocate the chord names) when key or mode changed
+	if (diatonicChordsFor == std::pair(key, mode)) return;
+	diatonicChordsFor = std::pair(key, mode);
+
 	diatonicChords.clear();
 	const auto scale = buildScale(key, mode);
 
@@ -89,7 +98,12 @@ inline void generateDiatonicChords(const Note key, const Scale mode) {
 	}
 }
 
-inline std::vector<std::pair<Chord, int>> scoreChords(const std::vector<Note>& melodySegment, const Scale scale) {
+/** Scores the diatonic chords (pointers stay valid until the next generateDiatonicChords() call) */
+inline std::pmr::vector<std::pair<const Chord*, int>> scoreChords(
+	const std::span<const Note> melodySegment,
+	const Scale scale,
+	std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+) {
 	// Count the occurrences of each pitch class (0–11)
 	std::array<int, 12> pitchCount{};
 	for (const Note note : melodySegment) {
@@ -97,7 +111,8 @@ inline std::vector<std::pair<Chord, int>> scoreChords(const std::vector<Note>& m
 	}
 
 	// Calculate the score (how many chord notes appear in the melody segment)
-	std::vector<std::pair<Chord, int>> scoredChords;
+	std::pmr::vector<std::pair<const Chord*, int>> scoredChords(memory);
+	scoredChords.reserve(diatonicChords.size());
 	for (const auto& chord : diatonicChords) {
 		int score = 0;
 		for (const Note interval : chord.type.intervals) {
@@ -123,7 +138,7 @@ inline std::vector<std::pair<Chord, int>> scoreChords(const std::vector<Note>& m
 		else if (chord.type.quality == "major add9" || chord.type.quality == "minor add9")
 			score -= bias(gen);
 
-		scoredChords.emplace_back(chord, score);
+		scoredChords.emplace_back(&chord, score);
 	}
 
 	// Sort chords by descending score
@@ -135,19 +150,26 @@ inline std::vector<std::pair<Chord, int>> scoreChords(const std::vector<Note>& m
 }
 
 
-inline Chord getChord(const std::vector<Note>& segment, const Scale scale) {
+inline const Chord NO_CHORD{};
+
+/** Best-matching diatonic chord (valid until the next generateDiatonicChords() call), or NO_CHORD */
+inline const Chord& getChord(
+	const std::span<const Note> segment,
+	const Scale scale,
+	std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+) {
 	// Score the diatonic chords based on the melody segment
-	const auto scored = scoreChords(segment, scale);
+	const auto scored = scoreChords(segment, scale, memory);
 
 	if (scored.empty() || scored[0].second == 0) {
 		std::cout << "No diatonic chord fits this segment well." << std::endl;
-		return {};
+		return NO_CHORD;
 	}
 
 	// Print the best-matching chord
 	std::cout << "Chord for this measure: "
-		<< scored[0].first.name
+		<< scored[0].first->name
 	<< std::endl;
 
-	return scored[0].first;
+	return *scored[0].first;
 }
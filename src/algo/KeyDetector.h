@@ -189,37 +189,35 @@ inline void updateMelodyMetadata(const Melody& melody, KeyDetectionResult* outRe
 }
 
 
-inline void fitToChord(smf::MidiFile& midiFile, const Note themeKey, const Chord& chord) {
-	const auto chordQuality= basicQuality(chord);
+/** Transposes a single note of a theme in `themeKey` so that it fits the chord */
+inline int fitNoteToChord(const int note, const Note themeKey, const Chord& chord) {
+	const auto chordQuality = basicQuality(chord);
 	const auto chordRoot = chordQuality == "minor"
 		? chord.root + 3
 		: chord.root;
 
-	const int semitoneShift = interval(themeKey, chordRoot);
-	std::cout << "Semitone shift: " << semitoneShift << std::endl;
-
-	for (int track = 0; track < midiFile.getTrackCount(); ++track) {
-		for (int event = 0; event < midiFile[track].size(); ++event) {
-			auto& midiEvent = midiFile[track][event];
+	int newNote = transpose(note, interval(themeKey, chordRoot));
 
-			if (midiEvent.isNoteOn() || midiEvent.isNoteOff()) {
-				const int note = midiEvent.getKeyNumber();
-				int newNote = transpose(note, semitoneShift);
-				const auto intervalFromChordRoot = interval(chordRoot, newNote % 12);
+	if (chordQuality == "sus") {
+		const auto intervalFromChordRoot = interval(chordRoot, newNote % 12);
+		const auto susInterval = (intervalFromChordRoot - 3) % 12;
+		bool keepNote = susInterval == 0 || susInterval == 7;
+		if (chord.type.quality == "sus2" && susInterval == 2) keepNote = true;
+		if (chord.type.quality == "sus4" && susInterval == 5) keepNote = true;
 
-				if (midiEvent.isNoteOn()) std::cout << "Chord root: " << chordRoot << ", note: " << newNote % 12 << ", interval: " << intervalFromChordRoot << std::endl;
+		if (!keepNote) newNote = transpose(newNote, -intervalFromChordRoot);
+	}
 
-				if (chordQuality == "sus") {
-					const auto susInterval = (intervalFromChordRoot - 3) % 12;
-					bool keepNote = susInterval == 0 || susInterval == 7;
-					if (chord.type.quality == "sus2" && susInterval == 2) keepNote = true;
-					if (chord.type.quality == "sus4" && susInterval == 5) keepNote = true;
+	return newNote;
+}
 
-					if (!keepNote) newNote = transpose(newNote, -intervalFromChordRoot);
-				}
+inline void fitToChord(smf::MidiFile& midiFile, const Note themeKey, const Chord& chord) {
+	for (int track = 0; track < midiFile.getTrackCount(); ++track) {
+		for (int event = 0; event < midiFile[track].size(); ++event) {
+			auto& midiEvent = midiFile[track][event];
 
-				midiEvent.setKeyNumber(newNote);
-			}
+			if (midiEvent.isNoteOn() || midiEvent.isNoteOff())
+				midiEvent.setKeyNumber(fitNoteToChord(midiEvent.getKeyNumber(), themeKey, chord));
 		}
 	}
 }
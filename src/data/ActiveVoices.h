@@ -0,0 +1,57 @@
+#pragma once
+
+#include "util/Util.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+
+/**
+ * Tracks which notes are currently sounding, as one 128-bit set per MIDI channel.
+ * The bits are atomic, so notes can be started by the playback thread while another thread silences everything.
+ * Notes must be valid MIDI keys (0..127).
+ */
+class ActiveVoices {
+public:
+	/** Marks a note as sounding, returns whether it already was */
+	bool add(const unsigned char channel, const Note note) {
+		const uint64_t mask = bit(note);
+		return word(channel, note).fetch_or(mask, std::memory_order_relaxed) & mask;
+	}
+
+	/** Marks a note as released, returns whether it was sounding */
+	bool remove(const unsigned char channel, const Note note) {
+		const uint64_t mask = bit(note);
+		return word(channel, note).fetch_and(~mask, std::memory_order_relaxed) & mask;
+	}
+
+	[[nodiscard]] bool contains(const unsigned char channel, const Note note) const {
+		return voices[channel][note >> 6].load(std::memory_order_relaxed) & bit(note);
+	}
+
+	/** Clears a channel and calls `release(note)` for every note that was sounding on it */
+	template<typename Release>
+	void releaseAll(const unsigned char channel, Release release) {
+		for (int w = 0; w < 2; ++w) {
+			uint64_t bits = voices[channel][w].exchange(0, std::memory_order_relaxed);
+			while (bits) {
+				const int idx = std::countr_zero(bits);
+				release(static_cast<Note>(w * 64 + idx));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+private:
+	std::array<std::array<std::atomic<uint64_t>, 2>, MIDI_CHANNELS> voices{};
+
+	static uint64_t bit(const Note note) {
+		return uint64_t{1} << (note & 63);
+	}
+
+	std::atomic<uint64_t>& word(const unsigned char channel, const Note note) {
+		return voices[channel][note >> 6];
+	}
+};
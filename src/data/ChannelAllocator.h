@@ -0,0 +1,98 @@
+#pragma once
+
+#include "util/Util.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+
+/**
+ * Hands out MIDI channels for themes from a free-list bitmap.
+ * Channels are spread over banks of 16 (FluidSynth's extended channels, see `synth.midi-channels`):
+ * the core instruments (0–2) are reserved in the first bank, and every bank's drum channel (9) is skipped.
+ * Allocation picks the lowest free channel with a find-first-set instead of scanning all active themes.
+ * A theme's channel is not freed right away: the Lua side retire()s it, and the play loop takes the retired channels,
+ * silences them and release()s each one once the events it already scheduled on it have been dispatched.
+ * The bitmaps are atomic, so allocate()/retire() and takeRetired()/release() can run on those two threads.
+ */
+class ChannelAllocator {
+public:
+	explicit ChannelAllocator(const int numChannels = MIDI_CHANNELS) {
+		for (int ch = 0; ch < numChannels && ch < MIDI_CHANNELS; ++ch) {
+			if (ch <= 2 || ch % 16 == 9) continue;  // LEAD, CHORDS, BASS and the drum channels
+			allocatableBits[ch / 64] |= uint64_t{1} << (ch % 64);
+			++numAllocatable;
+		}
+		for (size_t w = 0; w < freeBits.size(); ++w)
+			freeBits[w].store(allocatableBits[w], std::memory_order_relaxed);
+	}
+
+	/** Lowest free channel, or -1 if all are taken (counted as an allocation failure) */
+	int allocate() {
+		for (size_t w = 0; w < freeBits.size(); ++w) {
+			uint64_t bits = freeBits[w].load(std::memory_order_acquire);
+			while (bits != 0 && !freeBits[w].compare_exchange_weak(bits, bits & (bits - 1), std::memory_order_acq_rel)) {}
+			if (bits == 0) continue;
+
+			const int inUse = ++numInUse;
+			if (inUse > peakInUse.load(std::memory_order_relaxed))
+				peakInUse.store(inUse, std::memory_order_relaxed);
+
+			return static_cast<int>(w) * 64 + std::countr_zero(bits);
+		}
+
+		failures.fetch_add(1, std::memory_order_relaxed);
+		return -1;
+	}
+
+	/** Hand an allocated channel back for reuse (once nothing plays on it anymore) */
+	void release(const int channel) {
+		if (!isAllocatable(channel)) return;
+
+		const uint64_t mask = uint64_t{1} << (channel % 64);
+		if (freeBits[channel / 64].fetch_or(mask, std::memory_order_acq_rel) & mask) return;  // Was not allocated
+		--numInUse;
+	}
+
+	/** Mark an allocated channel as no longer used by its theme, to be released by takeRetired()'s caller */
+	void retire(const int channel) {
+		if (!isAllocatable(channel)) return;
+		retiredBits[channel / 64].fetch_or(uint64_t{1} << (channel % 64), std::memory_order_release);
+	}
+
+	/** Call `onRetired(channel)` for every channel retired since the last call */
+	template<typename F>
+	void takeRetired(F&& onRetired) {
+		for (size_t w = 0; w < retiredBits.size(); ++w) {
+			uint64_t bits = retiredBits[w].exchange(0, std::memory_order_acquire);
+			while (bits) {
+				onRetired(static_cast<int>(w) * 64 + std::countr_zero(bits));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+	// Metrics (safe to query from other threads)
+	[[nodiscard]] int capacity() const { return numAllocatable; }
+	[[nodiscard]] int inUse() const { return numInUse.load(std::memory_order_relaxed); }
+	[[nodiscard]] int peak() const { return peakInUse.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t failureCount() const { return failures.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t WORDS = (MIDI_CHANNELS + 63) / 64;
+
+	std::array<std::atomic<uint64_t>, WORDS> freeBits{};	// Set bit = channel is free
+	std::array<std::atomic<uint64_t>, WORDS> retiredBits{};	// Set bit = retired, not yet taken by the play loop
+	std::array<uint64_t, WORDS> allocatableBits{};			// Set bit = channel can be handed out at all
+
+	int numAllocatable = 0;
+	std::atomic<int> numInUse{0};
+	std::atomic<int> peakInUse{0};
+	std::atomic<uint64_t> failures{0};
+
+	[[nodiscard]] bool isAllocatable(const int channel) const {
+		return channel >= 0 && channel < MIDI_CHANNELS && allocatableBits[channel / 64] & uint64_t{1} << (channel % 64);
+	}
+};
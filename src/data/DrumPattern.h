@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <functional>
+#include <map>
+#include <tuple>
 
 #include "../util/Timing.h"
 #include "Instrument.h"
@@ -10,55 +14,149 @@ enum class DrumPattern {
 	NONE, CALM, STEALTH, TENSE, COMBAT, BOSS
 };
 
+constexpr size_t NUM_DRUM_PATTERNS = 6;
+
 using BeatOffset = double;  // e.g., 0.0 = downbeat 1, 0.5 = 8th note after downbeat, 1.75 = 16th before beat 3
 using Pattern = std::unordered_map<Note, std::vector<BeatOffset>>;
 
 
-/** Returns a pattern map using the provided note scheduler */
-inline std::unordered_map<DrumPattern, Pattern> getDrumPatterns(const TimeSignatureInfo& tsInfo) {
+/** Built-in grooves, defined for 4/4 */
+inline std::unordered_map<DrumPattern, Pattern> getBuiltinDrumPatterns() {
 	using namespace std;
 	using namespace Instrument;
 
-	if (tsInfo.num == 4 && tsInfo.denom == 4)
-		return {
-			{ DrumPattern::NONE, {
-			}},
-
-			{ DrumPattern::CALM, {
-				{BASS_DRUM_1, { 0.0 }},
-				{CLOSED_HAT,  { 0.0, 1.0, 2.0, 3.0 }}
-			}},
-
-			{ DrumPattern::STEALTH, {
-				{BASS_DRUM_1, { 0.0 }},
-				{PEDAL_HAT,   { 1.0, 1.67, 3.0, 3.67 }},
-				{OPEN_HAT,    { 0.0, 2.0 }}
-			}},
-
-			{ DrumPattern::TENSE, {
-				{BASS_DRUM_1, { 0.0, 1.5, 2.0 }},
-				{CLOSED_HAT,  { 0.0, 1.0, 2.0, 3.0 }}
-			}},
-
-			{ DrumPattern::COMBAT, {
-				{BASS_DRUM_1, { 0.0, 1.5, 2.5 }},
-				{SNARE_1,     { 1.0, 3.0 }},
-				{OPEN_HAT,    { 0.0, 1.0, 2.0, 3.0 }},
-				{SPLASH_CYM,  { 0.0, 1.0, 2.0, 3.0 }}
-			}},
-
-			{ DrumPattern::BOSS, {
-				{BASS_DRUM_1, { 0.0, 0.75, 1.25, 2.0, 2.75, 3.25 }},
-				{SNARE_1,     { 0.5, 1.5, 2.5, 3.5 }},
-				{OPEN_HAT,    { 0.0, 1.0, 2.0, 3.0 }},
-				{SPLASH_CYM,  { 0.0, 0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5 }}
-			}}
-		};
-
-	return {};
+	return {
+		{ DrumPattern::NONE, {
+		}},
+
+		{ DrumPattern::CALM, {
+			{BASS_DRUM_1, { 0.0 }},
+			{CLOSED_HAT,  { 0.0, 1.0, 2.0, 3.0 }}
+		}},
+
+		{ DrumPattern::STEALTH, {
+			{BASS_DRUM_1, { 0.0 }},
+			{PEDAL_HAT,   { 1.0, 1.67, 3.0, 3.67 }},
+			{OPEN_HAT,    { 0.0, 2.0 }}
+		}},
+
+		{ DrumPattern::TENSE, {
+			{BASS_DRUM_1, { 0.0, 1.5, 2.0 }},
+			{CLOSED_HAT,  { 0.0, 1.0, 2.0, 3.0 }}
+		}},
+
+		{ DrumPattern::COMBAT, {
+			{BASS_DRUM_1, { 0.0, 1.5, 2.5 }},
+			{SNARE_1,     { 1.0, 3.0 }},
+			{OPEN_HAT,    { 0.0, 1.0, 2.0, 3.0 }},
+			{SPLASH_CYM,  { 0.0, 1.0, 2.0, 3.0 }}
+		}},
+
+		{ DrumPattern::BOSS, {
+			{BASS_DRUM_1, { 0.0, 0.75, 1.25, 2.0, 2.75, 3.25 }},
+			{SNARE_1,     { 0.5, 1.5, 2.5, 3.5 }},
+			{OPEN_HAT,    { 0.0, 1.0, 2.0, 3.0 }},
+			{SPLASH_CYM,  { 0.0, 0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5 }}
+		}}
+	};
+}
+
+constexpr int BUILTIN_PATTERN_BEATS = 4;
+
+
+/** A single drum hit within a measure */
+struct DrumHit {
+	BeatOffset offset;
+	Note note;
+	int velocity;
+};
+
+
+/**
+ * A drum pattern compiled into a flat, time-sorted array of hits,
+ * with the hit offsets precomputed in timeline ticks (independent of the tempo).
+ */
+class CompiledDrumPattern {
+public:
+	CompiledDrumPattern() = default;
+
+	explicit CompiledDrumPattern(std::vector<DrumHit> hits) : hits(std::move(hits)) {
+		std::ranges::stable_sort(this->hits, {}, &DrumHit::offset);
+
+		offsets.reserve(this->hits.size());
+		for (const auto& hit : this->hits)
+			offsets.push_back(std::llround(hit.offset * PPQ));
+	}
+
+	[[nodiscard]] const std::vector<DrumHit>& getHits() const { return hits; }
+
+	/** Hit offsets from the measure start in ticks, parallel to getHits() */
+	[[nodiscard]] const std::vector<Tick>& getOffsets() const { return offsets; }
+
+private:
+	std::vector<DrumHit> hits;
+	std::vector<Tick> offsets;
+};
+
+using DrumPatternSet = std::array<CompiledDrumPattern, NUM_DRUM_PATTERNS>;  // Indexed by DrumPattern
+
+
+/** Parses a meter string such as "7/8" */
+inline std::pair<int, int> parseMeter(const std::string& meter) {
+	const auto slash = meter.find('/');
+	try {
+		if (slash != std::string::npos) {
+			const int num   = std::stoi(meter.substr(0, slash));
+			const int denom = std::stoi(meter.substr(slash + 1));
+			if (num > 0 && denom > 0) return {num, denom};
+		}
+	} catch (const std::exception&) {}
+
+	throw std::invalid_argument("Invalid meter: " + meter);
 }
 
 
+/**
+ * Drum pattern definitions per meter.
+ * Patterns can be (re)defined for any meter, e.g. from Lua via music.define_drum_pattern.
+ * Built-in 4/4 grooves are adapted to meters without an explicit definition by repeating
+ * their beats cyclically and cutting them off at the end of the measure.
+ */
+class DrumPatternLibrary {
+public:
+	void define(const DrumPattern pattern, const int num, const int denom, std::vector<DrumHit> hits) {
+		custom[{static_cast<int>(pattern), num, denom}] = std::move(hits);
+	}
+
+	[[nodiscard]] DrumPatternSet compile(const TimeSignatureInfo& tsInfo) const {
+		const auto builtins = getBuiltinDrumPatterns();
+
+		DrumPatternSet compiled;
+		for (size_t p = 0; p < NUM_DRUM_PATTERNS; ++p) {
+			if (const auto it = custom.find({static_cast<int>(p), tsInfo.num, tsInfo.denom}); it != custom.end()) {
+				compiled[p] = CompiledDrumPattern(it->second);
+				continue;
+			}
+
+			std::vector<DrumHit> hits;
+			if (const auto it = builtins.find(static_cast<DrumPattern>(p)); it != builtins.end()) {
+				for (const auto& [note, beatOffsets] : it->second) {
+					for (const BeatOffset offset : beatOffsets) {
+						for (BeatOffset beat = offset; beat < tsInfo.num; beat += BUILTIN_PATTERN_BEATS)
+							hits.push_back({beat, note, DRUMS.velocity});
+					}
+				}
+			}
+			compiled[p] = CompiledDrumPattern(std::move(hits));
+		}
+		return compiled;
+	}
+
+private:
+	std::map<std::tuple<int, int, int>, std::vector<DrumHit>> custom;  // (pattern, num, denom) -> hits
+};
+
+
 inline std::string getDrumPatternName(const DrumPattern drumPattern) {
 	switch (drumPattern) {
 		case DrumPattern::NONE:    return "None";
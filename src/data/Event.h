@@ -3,6 +3,10 @@
 #include "util/Util.h"
 #include "util/Timing.h"
 
+#include <algorithm>
+#include <memory>
+#include <span>
+
 
 /** An event (note, pause, etc.) within a melody */
 struct Event {
@@ -36,22 +40,22 @@ struct FixedEvent final : Event {
 	}
 };
 
-/** Event information with scheduled global time point */
+/** Event information with scheduled position on the playback timeline */
 struct ScheduledEvent final : Event {
-	Clock::time_point startTime;  // Start time within the melody
-	double duration;			  // In microseconds
+	Tick start;		// Start tick within the playback
+	Tick duration;	// In ticks
 
 	ScheduledEvent(
 		const Note note,
-		const Clock::time_point& startTime,
-		const double duration
-	) : startTime(startTime), duration(duration) {
+		const Tick start,
+		const Tick duration
+	) : start(start), duration(duration) {
 		this->note = note;
 	}
 };
 
 struct ScheduledPlaybackEvent {
-	Clock::time_point startTime;
+	Tick tick;  // Converted to wall time only when dispatched
 	Note note{};
 	int channel{};
 	int velocity{};
@@ -100,13 +104,27 @@ namespace std {
 
 template <typename T>
 	struct VectorHash {
-	size_t operator()(const std::vector<T>& vec) const {
+	using is_transparent = void;
+
+	size_t operator()(const std::span<const T> vec) const {
 		size_t seed = vec.size();
 		for (const auto& item : vec) {
 			seed ^= std::hash<T>()(item) + PHI_32 + (seed << 6) + (seed >> 2);
 		}
 		return seed;
 	}
+	size_t operator()(const std::vector<T>& vec) const {
+		return (*this)(std::span<const T>(vec));
+	}
+};
+
+template <typename T>
+struct VectorEqual {
+	using is_transparent = void;
+
+	bool operator()(const std::span<const T> a, const std::span<const T> b) const {
+		return std::ranges::equal(a, b);
+	}
 };
 
 
@@ -198,7 +198,7 @@ namespace Instrument {
 
 
 struct ActiveInstrument {
-	int channel;   // MIDI channel (0–15), dynamically assigned
+	int channel;   // MIDI channel (0 to MIDI_CHANNELS - 1), dynamically assigned
 	int program;   // General MIDI program number (0–127)
 	int velocity;  // Default velocity (0–127) for this instrument
 };
@@ -2,17 +2,18 @@
 
 #include "Event.h"
 
-#include <deque>
+#include <algorithm>
 #include <random>
 #include <ranges>
+#include <span>
 #include <unordered_map>
 
 
 using T = std::shared_ptr<Event>;
 
 
-// RNG
-static std::mt19937 gen(std::random_device{}());
+// RNG (one per thread, so sessions on different worker threads never share it)
+static thread_local std::mt19937 gen(std::random_device{}());
 
 
 /** Stores relevant data for a given transition within a Markov chain */
@@ -40,23 +41,39 @@ struct TransitionData {
 };
 
 
-/** Deque buffer to store note transitions while training on live performance MIDI data */
+/**
+ * Buffer of the last `maxSize` events (the context of a Markov chain).
+ * Stored contiguously with a fixed capacity, so the context can be looked at without copying it.
+ */
 class FixedQueue {
 public:
 	size_t maxSize{};
 
 	FixedQueue() = default;
-	explicit FixedQueue(const size_t maxSize) : maxSize(maxSize) {}
+	explicit FixedQueue(const size_t maxSize) : maxSize(maxSize) {
+		queue.reserve(maxSize);
+	}
 
 	void push(const T& value) {
 		if (size() == maxSize) {
-			queue.pop_front();
+			std::shift_left(queue.begin(), queue.end(), 1);
+			queue.back() = value;
+			return;
 		}
 		queue.push_back(value);
 	}
 
+	/** Replace all events with the same one (e.g. the START token) */
+	void fill(const T& value) {
+		queue.assign(maxSize, value);
+	}
+
+	[[nodiscard]] std::span<const T> view() const {
+		return queue;
+	}
+
 	[[nodiscard]] std::vector<T> getSnapshot() const {
-		return {queue.begin(), queue.end()};
+		return queue;
 	}
 
 	[[nodiscard]] size_t size() const {
@@ -64,7 +81,14 @@ public:
 	}
 
 private:
-	std::deque<T> queue;
+	std::vector<T> queue;
+};
+
+
+/** A continuation sampled from a Markov chain */
+struct MarkovSample {
+	const T* next;		// The chain's own event (no new allocation), only its note is meaningful
+	double duration;	// Sampled duration in microseconds
 };
 
 
@@ -97,7 +121,8 @@ public:
 		}
 	}
 
-	[[nodiscard]] std::optional<T> getNext(const std::vector<T>& context) const {
+	/** Sample the next event for a context, looked up in place (no copies, no allocations) */
+	[[nodiscard]] std::optional<MarkovSample> sample(const std::span<const T> context) const {
 		if (transitions.empty())
 			return std::nullopt;
 
@@ -115,15 +140,9 @@ public:
 		std::uniform_int_distribution dist(1, total);
 		int choice = dist(gen);
 
-		for (const auto& data: nextMap | std::views::values) {
+		for (const auto& [next, data]: nextMap) {
 			if ((choice -= data.count) > 0) continue;
-
-			// Construct a FullEvent using stored note and sampled duration
-			return std::make_shared<FixedEvent>(
-				data.note,
-				MusicTimePoint(),	// will be overwritten
-				data.sampleDuration()
-			);
+			return MarkovSample{&next, data.sampleDuration()};
 		}
 
 		// Should not reach here if total > 0
@@ -131,11 +150,10 @@ public:
 	}
 
 	/** @brief Fall back to shorter Markov chain if no continuation was found to prevent the program from halting */
-	[[nodiscard]] std::optional<T> getNextWithFallback(const std::vector<T>& context) const {
+	[[nodiscard]] std::optional<MarkovSample> sampleWithFallback(const std::span<const T> context) const {
 		// Try progressively shorter contexts
 		for (size_t len = context.size(); len >= 1; --len) {
-			std::vector subcontext(context.end() - static_cast<int>(len), context.end());
-			auto result = getNext(subcontext);
+			auto result = sample(context.last(len));
 			if (result.has_value()) return result;
 		}
 
@@ -143,8 +161,21 @@ public:
 		return std::nullopt;
 	}
 
+	[[nodiscard]] std::optional<T> getNext(const std::span<const T> context) const {
+		const auto result = sample(context);
+		if (!result.has_value())
+			return std::nullopt;
+
+		// Construct a FullEvent using stored note and sampled duration
+		return std::make_shared<FixedEvent>(
+			(*result->next)->note,
+			MusicTimePoint(),	// will be overwritten
+			result->duration
+		);
+	}
+
 	/** @brief Get all possible next transitions for a given context */
-	const std::unordered_map<T, TransitionData>* getTransitionsForContextRef(const std::vector<T>& context) const {
+	const std::unordered_map<T, TransitionData>* getTransitionsForContextRef(const std::span<const T> context) const {
 		const auto it = transitions.find(context);
 		if (it != transitions.end())
 			return& it->second;
@@ -157,6 +188,7 @@ private:
 	std::unordered_map<
 		std::vector<T>,							// Key: context of "order" previous events
 		std::unordered_map<T, TransitionData>,	// Value: next event
-		VectorHash<T>							// Custom hash for event vectors
+		VectorHash<T>,							// Custom hash for event vectors
+		VectorEqual<T>							// Both also take spans, so contexts are looked up without copies
 	> transitions;
 };
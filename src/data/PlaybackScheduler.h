@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Event.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Persistent, time-ordered queue for note on/off events.
+ * Events are stored in a pool of reusable nodes and ordered by a binary min-heap of node indices,
+ * so events that drag over into later measures simply stay queued instead of being re-partitioned.
+ * Events are ordered by timeline tick, events with the same tick are dispatched in insertion order.
+ */
+class PlaybackScheduler {
+public:
+	explicit PlaybackScheduler(const size_t capacity = 1024) {
+		reserve(capacity);
+	}
+
+	/** Pre-allocate node storage so that pushing up to this many events doesn't allocate */
+	void reserve(const size_t capacity) {
+		nodes.reserve(capacity);
+		freeNodes.reserve(capacity);
+		heap.reserve(capacity);
+	}
+
+	void push(const ScheduledPlaybackEvent& event) {
+		uint32_t idx;
+		if (!freeNodes.empty()) {
+			idx = freeNodes.back();
+			freeNodes.pop_back();
+			nodes[idx] = Node{event, nextSeq++};
+		} else {
+			idx = static_cast<uint32_t>(nodes.size());
+			nodes.push_back(Node{event, nextSeq++});
+
+			// Popping must never allocate: the free list can hold every node
+			if (freeNodes.capacity() < nodes.capacity())
+				freeNodes.reserve(nodes.capacity());
+		}
+
+		heap.push_back(idx);
+		siftUp(heap.size() - 1);
+	}
+
+	/** Call `f(data, bytes)` for each reserved buffer (e.g. to lock them into memory) */
+	template<typename F>
+	void forEachBuffer(F&& f) const {
+		f(static_cast<const void*>(nodes.data()), nodes.capacity() * sizeof(Node));
+		f(static_cast<const void*>(freeNodes.data()), freeNodes.capacity() * sizeof(uint32_t));
+		f(static_cast<const void*>(heap.data()), heap.capacity() * sizeof(uint32_t));
+	}
+
+	[[nodiscard]] bool empty() const { return heap.empty(); }
+	[[nodiscard]] size_t size() const { return heap.size(); }
+
+	/** Earliest queued event (the scheduler must not be empty) */
+	[[nodiscard]] const ScheduledPlaybackEvent& top() const {
+		return nodes[heap.front()].event;
+	}
+
+	/** Pops the earliest event into `out` if it starts at or before `until` */
+	bool popDue(const Tick until, ScheduledPlaybackEvent& out) {
+		if (heap.empty() || top().tick > until)
+			return false;
+
+		out = top();
+		popTop();
+		return true;
+	}
+
+	/** Drops all events that start at or before `until` */
+	void dropUntil(const Tick until) {
+		while (!heap.empty() && top().tick <= until)
+			popTop();
+	}
+
+	void clear() {
+		nodes.clear();
+		freeNodes.clear();
+		heap.clear();
+	}
+
+private:
+	struct Node {
+		ScheduledPlaybackEvent event;
+		uint64_t seq;  // Insertion counter, keeps events with equal ticks in FIFO order
+	};
+
+	std::vector<Node> nodes;			// Node pool, indices stay valid while the node is queued
+	std::vector<uint32_t> freeNodes;	// Recycled pool indices
+	std::vector<uint32_t> heap;			// Min-heap of pool indices, ordered by (tick, seq)
+	uint64_t nextSeq = 0;
+
+	[[nodiscard]] bool earlier(const uint32_t a, const uint32_t b) const {
+		const Node& na = nodes[a];
+		const Node& nb = nodes[b];
+		if (na.event.tick != nb.event.tick)
+			return na.event.tick < nb.event.tick;
+		return na.seq < nb.seq;
+	}
+
+	void popTop() {
+		freeNodes.push_back(heap.front());
+		heap.front() = heap.back();
+		heap.pop_back();
+		if (!heap.empty()) siftDown(0);
+	}
+
+	void siftUp(size_t i) {
+		while (i > 0) {
+			const size_t parent = (i - 1) / 2;
+			if (!earlier(heap[i], heap[parent])) break;
+			std::swap(heap[i], heap[parent]);
+			i = parent;
+		}
+	}
+
+	void siftDown(size_t i) {
+		const size_t n = heap.size();
+		while (true) {
+			const size_t left  = 2 * i + 1;
+			const size_t right = left + 1;
+			size_t smallest = i;
+
+			if (left  < n && earlier(heap[left],  heap[smallest])) smallest = left;
+			if (right < n && earlier(heap[right], heap[smallest])) smallest = right;
+			if (smallest == i) break;
+
+			std::swap(heap[i], heap[smallest]);
+			i = smallest;
+		}
+	}
+};
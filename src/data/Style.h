@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+
+enum class LeadStyle {
+	SUSTAIN, PULSE
+};
+
+enum class BassStyle {
+	SUSTAIN, PULSE, FAST
+};
+
+constexpr size_t NUM_LEAD_STYLES = 2;
+constexpr size_t NUM_BASS_STYLES = 3;
+
+
+/** How a lead style shapes each melody note */
+struct LeadStyleParams {
+	double durationFactor;	// Multiplier for the generated note duration
+	bool restAfterNote;		// Add a pause of the same length after each note (staccato)
+};
+
+/** Lead style parameters, indexed by LeadStyle */
+inline constexpr std::array<LeadStyleParams, NUM_LEAD_STYLES> leadStyleParams = {{
+	{ 1.0, false },  // SUSTAIN
+	{ 0.5, true  }   // PULSE
+}};
+
+inline const LeadStyleParams& getLeadStyleParams(const LeadStyle style) {
+	return leadStyleParams[static_cast<size_t>(style)];
+}
+
+
+/** Style names as used in Lua, indexed by LeadStyle / BassStyle (rule validation uses them too, see ValidLiterals.h) */
+inline constexpr std::array<const char*, NUM_LEAD_STYLES> leadStyleNames = {"Sustain", "Pulse"};
+inline constexpr std::array<const char*, NUM_BASS_STYLES> bassStyleNames = {"Sustain", "Pulse", "Fast"};
+
+/** "A, B, C" for error messages */
+template<size_t N>
+std::string joinStyleNames(const std::array<const char*, N>& names) {
+	std::string joined;
+	for (const char* name : names) {
+		if (!joined.empty()) joined += ", ";
+		joined += name;
+	}
+	return joined;
+}
+
+
+inline std::string getLeadStyleName(const LeadStyle style) {
+	const auto index = static_cast<size_t>(style);
+	if (index >= NUM_LEAD_STYLES) throw std::invalid_argument("Invalid lead style");
+	return leadStyleNames[index];
+}
+
+inline LeadStyle getLeadStyle(const std::string& style) {
+	for (size_t i = 0; i < NUM_LEAD_STYLES; ++i)
+		if (style == leadStyleNames[i]) return static_cast<LeadStyle>(i);
+
+	throw std::invalid_argument("Invalid lead style: " + style + " (expected one of " + joinStyleNames(leadStyleNames) + ")");
+}
+
+
+inline std::string getBassStyleName(const BassStyle style) {
+	const auto index = static_cast<size_t>(style);
+	if (index >= NUM_BASS_STYLES) throw std::invalid_argument("Invalid bass style");
+	return bassStyleNames[index];
+}
+
+inline BassStyle getBassStyle(const std::string& style) {
+	for (size_t i = 0; i < NUM_BASS_STYLES; ++i)
+		if (style == bassStyleNames[i]) return static_cast<BassStyle>(i);
+
+	throw std::invalid_argument("Invalid bass style: " + style + " (expected one of " + joinStyleNames(bassStyleNames) + ")");
+}
@@ -0,0 +1,185 @@
+#include "SessionHost.h"
+
+using namespace std;
+
+
+namespace {
+	thread_local bool realTimeWorker = false;  // enterRealTimeMode() was called on this worker
+}
+
+
+SessionHost::SessionHost(const unsigned workerCount) {
+	workers.reserve(workerCount);
+	for (unsigned i = 0; i < workerCount; ++i)
+		workers.emplace_back([this] { workerLoop(); });
+
+	cout << "[SessionHost] Started " << workerCount << " worker threads\n";
+}
+
+SessionHost::~SessionHost() {
+	stopAll();
+
+	{
+		unique_lock lock(mutex);
+		drainedCV.wait(lock, [this] { return sessions.empty(); });
+		shuttingDown = true;
+	}
+	workCV.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+
+int SessionHost::addSession(const SessionConfig& config, function<void()> onEnded) {
+	auto session = make_shared<Session>();
+	session->music = make_unique<MusicMaker>(config, resources);
+	session->onEnded = move(onEnded);
+	session->music->setWakeCallback([this, weakSession = weak_ptr(session)] {
+		wake(weakSession);
+	});
+
+	lock_guard lock(mutex);
+	session->id = nextSessionId++;
+	sessions.emplace(session->id, session);
+	scheduleLocked(session, Clock::now());  // The first tick prepares the session
+
+	cout << "[SessionHost] Added session " << session->id << " on port " << config.port << endl;
+	return session->id;
+}
+
+void SessionHost::stopSession(const int id) {
+	shared_ptr<Session> session;
+	{
+		lock_guard lock(mutex);
+		const auto it = sessions.find(id);
+		if (it == sessions.end()) return;
+		session = it->second;
+	}
+	session->music->requestStop();  // Calls back into wake(), so not under the lock
+}
+
+void SessionHost::stopAll() {
+	vector<shared_ptr<Session>> running;
+	{
+		lock_guard lock(mutex);
+		for (const auto& session : sessions | views::values)
+			running.push_back(session);
+	}
+	for (const auto& session : running)
+		session->music->requestStop();
+}
+
+void SessionHost::waitForSession(const int id) {
+	unique_lock lock(mutex);
+	drainedCV.wait(lock, [&] { return !sessions.contains(id); });
+}
+
+size_t SessionHost::sessionCount() const {
+	lock_guard lock(mutex);
+	return sessions.size();
+}
+
+
+void SessionHost::scheduleLocked(const shared_ptr<Session>& session, const Clock::time_point wakeTime) {
+	const bool sleeps = wakeTime - Clock::now() > session->music->getConfig().spinWindow;
+	timers.push({wakeTime, ++session->timerGen, sleeps, session});
+	workCV.notify_one();
+}
+
+/** Re-evaluate a session right away (pause, resume, stop, client connected) */
+void SessionHost::wake(const weak_ptr<Session>& weakSession) {
+	const auto session = weakSession.lock();
+	if (!session) return;
+
+	lock_guard lock(mutex);
+	if (session->ticking)
+		session->wakePending = true;
+	else if (session->prepared)
+		scheduleLocked(session, Clock::now());
+}
+
+
+void SessionHost::workerLoop() {
+	unique_lock lock(mutex);
+	while (!shuttingDown) {
+		if (timers.empty()) {
+			workCV.wait(lock);
+			continue;
+		}
+
+		// Drop timers of ended sessions and timers that were superseded by a later (re)schedule
+		const Timer& next = timers.top();
+		auto session = next.session.lock();
+		if (!session || next.gen != session->timerGen || session->ticking) {
+			timers.pop();
+			continue;
+		}
+
+		// Sleep until the spin window before the deadline, then claim the session and spin the rest
+		const Clock::time_point coarseTarget = next.wakeTime - session->music->getConfig().spinWindow;
+		if (coarseTarget > Clock::now()) {
+			session.reset();
+			workCV.wait_until(lock, coarseTarget);
+			continue;
+		}
+		const Timer due = next;
+		timers.pop();
+
+		session->ticking = true;
+		session->wakePending = false;
+		lock.unlock();
+
+		if (session->music->getConfig().realTime && !realTimeWorker) {
+			enterRealTimeMode();
+			realTimeWorker = true;
+		}
+
+		const Clock::time_point coarseWake = Clock::now();
+		spinUntil(due.wakeTime);
+		if (due.sleeps) session->music->recordWake(due.wakeTime, coarseWake);
+
+		// Tick outside the lock, so that other workers can run other sessions in the meantime
+		auto result = MusicMaker::TickResult::WAITING;
+		Clock::time_point wakeTime = Clock::now();
+		bool prepared = session->prepared;
+		try {
+			if (!prepared) {
+				session->music->prepare();
+				prepared = true;
+			} else {
+				result = session->music->tick(wakeTime);
+			}
+		} catch (const exception& e) {
+			cerr << "[SessionHost] Session " << session->id << " failed: " << e.what() << endl;
+			result = MusicMaker::TickResult::STOPPED;
+		}
+
+		if (result == MusicMaker::TickResult::STOPPED) {
+			session->music->finish();
+			if (session->onEnded) session->onEnded();  // Before waitForSession() returns
+		}
+
+		lock.lock();
+		session->ticking = false;
+		session->prepared = prepared;
+
+		if (result == MusicMaker::TickResult::STOPPED) {
+			sessions.erase(session->id);
+			cout << "[SessionHost] Session " << session->id << " ended\n";
+
+			// Destroy the session (synth, sockets, Lua state) outside the lock
+			lock.unlock();
+			session.reset();
+			drainedCV.notify_all();
+			lock.lock();
+			continue;
+		}
+
+		if (result == MusicMaker::TickResult::WAITING)
+			scheduleLocked(session, wakeTime);
+		else if (session->wakePending)
+			scheduleLocked(session, Clock::now());
+		session->wakePending = false;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MusicMaker.h"
+#include "SharedResources.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Hosts many independent MusicMaker sessions (one per player or game instance) in one process.
+ * Sessions share their read-only resources (soundfonts, trained models, compiled themes) through one SharedResources
+ * and are driven by a fixed pool of worker threads instead of one playback thread each:
+ * every session is a timer in a min-heap, and whichever worker is free ticks the next session that is due.
+ * Workers sleep until the session's spin window before the deadline and spin the rest (like MusicMaker::play()),
+ * and a worker enters real-time mode the first time it runs a session with SessionConfig::realTime.
+ * Only playback (generation and dispatch) runs on the pool. Each session still owns its I/O threads:
+ * the GameBridge socket thread, the game state (Lua) thread, the FluidSynth audio driver and, with live input,
+ * the LiveMIDIInput consumer.
+ */
+class SessionHost {
+public:
+	explicit SessionHost(unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()));
+	~SessionHost();
+
+	SessionHost(const SessionHost&) = delete;
+	SessionHost& operator=(const SessionHost&) = delete;
+
+	/** Create a session and prepare it on the worker pool, returns its id. `onEnded` is called on a worker once it ended */
+	int addSession(const SessionConfig& config, std::function<void()> onEnded = {});
+	void stopSession(int id);
+	void stopAll();
+	void waitForSession(int id);  // Blocks until the session has ended (after stopSession())
+
+	[[nodiscard]] size_t sessionCount() const;
+	[[nodiscard]] const std::shared_ptr<SharedResources>& getResources() const { return resources; }
+
+private:
+	struct Session {
+		int id{};
+		std::unique_ptr<MusicMaker> music;
+		std::function<void()> onEnded;
+		bool prepared	 = false;
+		bool ticking	 = false;	// Currently run by a worker
+		bool wakePending = false;	// Woken up while ticking -> tick again right away
+		uint64_t timerGen = 0;		// Invalidates older timers of this session
+	};
+
+	struct Timer {
+		Clock::time_point wakeTime;
+		uint64_t gen;
+		bool sleeps;  // Far enough ahead to sleep until the spin window (wake-up jitter is recorded)
+		std::weak_ptr<Session> session;  // Sessions are only owned by `sessions`
+
+		bool operator>(const Timer& other) const { return wakeTime > other.wakeTime; }
+	};
+
+	std::shared_ptr<SharedResources> resources = std::make_shared<SharedResources>();
+
+	mutable std::mutex mutex;
+	std::condition_variable workCV;		// New or earlier timers, shutdown
+	std::condition_variable drainedCV;	// A session ended
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers;
+	std::unordered_map<int, std::shared_ptr<Session>> sessions;
+	int nextSessionId = 0;
+	bool shuttingDown = false;
+
+	std::vector<std::thread> workers;
+
+	void workerLoop();
+	void scheduleLocked(const std::shared_ptr<Session>& session, Clock::time_point wakeTime);
+	void wake(const std::weak_ptr<Session>& weakSession);
+};
@@ -0,0 +1,111 @@
+#include "SharedResources.h"
+
+#include "algo/ChordDetector.h"
+#include "algo/KeyDetector.h"
+#include "util/Util.h"
+
+using namespace std;
+using namespace smf;
+
+
+SharedResources::~SharedResources() {
+	// Wait for loads still running in the background
+	for (const auto& load : soundfonts | views::values)
+		load.wait();
+
+	if (sfontOwner)	   delete_fluid_synth(sfontOwner);  // Also frees all loaded soundfonts
+	if (sfontSettings) delete_fluid_settings(sfontSettings);
+}
+
+
+shared_ptr<const MidiFile> SharedResources::loadMIDI(const string& path) {
+	return midiFiles.get(path, [&]() -> shared_ptr<const MidiFile> {
+		const string fullPath = INPUT_DIR + path;
+
+		auto midiFile = make_shared<MidiFile>();
+		if (!midiFile->read(fullPath)) {
+			cerr << "[SharedResources] Failed to load MIDI file: " << fullPath << endl;
+			return nullptr;
+		}
+
+		// Analyze MIDI
+		midiFile->doTimeAnalysis();
+		midiFile->linkNotePairs();
+		midiFile->sortTracks();		// Ensure chronological order (sort by tick time) just in case
+		midiFile->absoluteTicks();	// Ensure we're in absolute tick mode
+
+		return midiFile;
+	});
+}
+
+shared_ptr<const MidiFile> SharedResources::findMIDI(const string& path) const {
+	return midiFiles.find(path);
+}
+
+
+/** Theme analysis that doesn't depend on the session: time signature and key */
+shared_ptr<const ThemeInfo> SharedResources::getTheme(const string& path) {
+	return themes.get(path, [&]() -> shared_ptr<const ThemeInfo> {
+		const auto midiFile = findMIDI(path);
+		if (!midiFile) return nullptr;
+
+		auto theme = make_shared<ThemeInfo>();
+		theme->midi   = *midiFile;
+		theme->tsInfo = extractTimeSignatureInfo(theme->midi);
+		theme->key	  = detectKey(theme->midi, theme->tsInfo).bestKey;
+
+		// Lay the notes out on the timeline, so that playback only has to pick and transpose them
+		const auto toTimeline = [tpq = theme->tsInfo.tpq](const int tick) {
+			return static_cast<Tick>(tick) * PPQ / tpq;
+		};
+		for (int track = 0; track < theme->midi.getTrackCount(); ++track) {
+			for (int event = 0; event < theme->midi[track].size(); ++event) {
+				const auto& midiEvent = theme->midi[track][event];
+				if (!(midiEvent.isNoteOn() && midiEvent.getVelocity() > 0)) continue;
+
+				theme->notes.push_back({
+					toTimeline(midiEvent.tick),
+					static_cast<Note>(midiEvent.getKeyNumber()),
+					toTimeline(midiEvent.getLinkedEvent()->tick - midiEvent.tick)
+				});
+			}
+		}
+		ranges::stable_sort(theme->notes, {}, &ThemeNote::offset);
+		theme->length = toTimeline(theme->midi.getFileDurationInTicks());
+
+		return theme;
+	});
+}
+
+
+shared_future<LoadedSoundfont> SharedResources::loadSoundfontAsync(const string& path) {
+	lock_guard lock(soundfontMutex);
+
+	if (const auto it = soundfonts.find(path); it != soundfonts.end())
+		return it->second;
+
+	auto load = async(launch::async, [this, path] { return loadSoundfont(path); }).share();
+	soundfonts.emplace(path, load);
+	return load;
+}
+
+LoadedSoundfont SharedResources::loadSoundfont(const string& path) {
+	lock_guard lock(sfontOwnerMutex);
+	const auto loadStart = Clock::now();
+
+	if (!sfontOwner) {
+		sfontSettings = new_fluid_settings();
+		fluid_settings_setint(sfontSettings, "synth.dynamic-sample-loading", 0);  // Shared: must never change
+		sfontOwner	  = new_fluid_synth(sfontSettings);
+	}
+
+	LoadedSoundfont loaded;
+	const int sfid = fluid_synth_sfload(sfontOwner, (RESOURCES_DIR + path).c_str(), 0);
+	if (sfid == FLUID_FAILED)
+		cerr << "[SharedResources] Failed to load soundfont: " << path << endl;
+	else
+		loaded.sfont = fluid_synth_get_sfont_by_id(sfontOwner, sfid);
+
+	loaded.loadTime = Clock::now() - loadStart;
+	return loaded;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <MidiFile.h>
+
+#include "data/MarkovChain.h"
+#include "output/OutputSink.h"
+#include "util/Timing.h"
+
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+/**
+ * Thread-safe, build-once cache of immutable values.
+ * The first caller of a key builds the value, concurrent callers of the same key wait for that result
+ * instead of building it again. Failed builds (nullptr or exception) are cached as well.
+ */
+template<typename V>
+class OnceCache {
+public:
+	using Ptr = std::shared_ptr<const V>;
+
+	template<typename Factory>
+	Ptr get(const std::string& key, Factory&& build) {
+		std::promise<Ptr> promise;
+		std::shared_future<Ptr> result;
+		bool owner = false;
+		{
+			std::lock_guard lock(mutex);
+			if (const auto it = entries.find(key); it != entries.end()) {
+				result = it->second;
+			} else {
+				result = promise.get_future().share();
+				entries.emplace(key, result);
+				owner = true;
+			}
+		}
+
+		if (owner) {
+			try {
+				promise.set_value(build());
+			} catch (...) {
+				promise.set_exception(std::current_exception());
+			}
+		}
+		return result.get();
+	}
+
+	/** Value of a key that has been requested before (waits if it is still being built), nullptr otherwise */
+	Ptr find(const std::string& key) const {
+		std::shared_future<Ptr> result;
+		{
+			std::lock_guard lock(mutex);
+			const auto it = entries.find(key);
+			if (it == entries.end()) return nullptr;
+			result = it->second;
+		}
+		return result.get();
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, std::shared_future<Ptr>> entries;
+};
+
+
+/** One note of a theme on the timeline (relative to the theme or window start) */
+struct ThemeNote {
+	Tick offset;
+	Note note;
+	Tick duration;
+};
+
+/** A theme MIDI file with its analysis, compiled once and shared between sessions */
+struct ThemeInfo {
+	smf::MidiFile midi;
+	TimeSignatureInfo tsInfo;
+	Note key{};
+	std::vector<ThemeNote> notes;  // Sorted by offset, in timeline ticks
+	Tick length{};				   // In timeline ticks
+};
+
+/** Everything trained from an input melody, shared between sessions using the same input and order */
+struct TrainedModel {
+	Melody melody;
+	TimeSignatureInfo tsInfo;
+	int order{};
+	MarkovChain chain;
+};
+
+
+/**
+ * Read-only resources shared by all sessions of one process.
+ * Everything handed out is immutable, so sessions can use it from any thread without further locking.
+ * Soundfonts are loaded with all their samples (no dynamic sample loading), so selecting or unselecting presets
+ * in the synths they are lent to never loads or frees anything in them.
+ */
+class SharedResources {
+public:
+	SharedResources() = default;
+	~SharedResources();
+
+	SharedResources(const SharedResources&) = delete;
+	SharedResources& operator=(const SharedResources&) = delete;
+
+	// MIDI files (path relative to the input directory)
+	std::shared_ptr<const smf::MidiFile> loadMIDI(const std::string& path);
+	std::shared_ptr<const smf::MidiFile> findMIDI(const std::string& path) const;
+	std::shared_ptr<const ThemeInfo> getTheme(const std::string& path);
+
+	/** Trained model for the given key, trained by `train` (returning a TrainedModel) if not cached yet */
+	template<typename Train>
+	std::shared_ptr<const TrainedModel> getModel(const std::string& key, Train&& train) {
+		return models.get(key, [&] {
+			return std::make_shared<const TrainedModel>(train());
+		});
+	}
+
+	/**
+	 * Start loading a soundfont (path relative to the resources directory) on a background thread, so that it
+	 * overlaps with other setup work. It is loaded only once and usable by any synth.
+	 */
+	std::shared_future<LoadedSoundfont> loadSoundfontAsync(const std::string& path);
+	fluid_sfont_t* getSoundfont(const std::string& path) { return loadSoundfontAsync(path).get().sfont; }
+
+private:
+	OnceCache<smf::MidiFile> midiFiles;
+	OnceCache<ThemeInfo> themes;
+	OnceCache<TrainedModel> models;
+
+	// Soundfonts are owned by a silent synth and only lent to the session synths
+	std::mutex soundfontMutex;
+	std::mutex sfontOwnerMutex;  // Serializes the loads themselves
+	fluid_settings_t* sfontSettings = nullptr;
+	fluid_synth_t* sfontOwner		= nullptr;
+	std::unordered_map<std::string, std::shared_future<LoadedSoundfont>> soundfonts;
+
+	LoadedSoundfont loadSoundfont(const std::string& path);
+};
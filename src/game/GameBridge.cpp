@@ -1,6 +1,14 @@
 #include "GameBridge.h"
+#include "GameData.h"
+#include "GameStateProtocol.h"
 
+#include <nlohmann/json.hpp>
+
+#include <chrono>
 #include <iostream>
+#include <ranges>
+#include <span>
+#include <vector>
 
 // Platform-specific includes/macros
 #ifdef _WIN32
@@ -10,27 +18,68 @@
 	typedef SOCKET SocketType;
 	#define CLOSESOCKET(s) closesocket(s)
 	#define IS_VALID_SOCKET(s) ((s) != INVALID_SOCKET)
+	#define POLL(fds, count, timeout) WSAPoll(fds, count, timeout)
+	#define WOULD_BLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+	#define INTERRUPTED() (WSAGetLastError() == WSAEINTR)
+	#define SEND_FLAGS 0
 #else
 	#include <arpa/inet.h>
+	#include <cerrno>
+	#include <fcntl.h>
 	#include <unistd.h>
 	#include <sys/socket.h>
 	#include <netinet/in.h>
+	#ifdef __linux__
+		#include <sys/epoll.h>
+	#else
+		#include <poll.h>
+		#define POLL(fds, count, timeout) poll(fds, count, timeout)
+	#endif
 	typedef int SocketType;
 	#define INVALID_SOCKET (-1)
 	#define CLOSESOCKET(s) close(s)
 	#define IS_VALID_SOCKET(s) ((s) >= 0)
+	#define WOULD_BLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+	#define INTERRUPTED() (errno == EINTR)
+	#ifdef MSG_NOSIGNAL
+		#define SEND_FLAGS MSG_NOSIGNAL  // A client gone in the meantime must not raise SIGPIPE (and kill the process)
+	#else
+		#define SEND_FLAGS 0  // macOS: SO_NOSIGPIPE is set on every client socket instead
+	#endif
 #endif
 
 using namespace std;
 
 
 // Globals
-constexpr u_short PORT = 5555;
-
 constexpr bool DEBUG_GB = true;
+constexpr int LISTEN_BACKLOG = 16;
+constexpr int IO_POLL_TIMEOUT_MS = 100;  // Only bounds how fast closeGameStateListener() is noticed
 
 
-GameBridge::GameBridge() = default;
+static bool setNonBlocking(const uintptr_t socket) {
+	#ifdef _WIN32
+		u_long mode = 1;
+		return ioctlsocket(static_cast<SocketType>(socket), FIONBIO, &mode) == 0;
+	#else
+		const int flags = fcntl(static_cast<SocketType>(socket), F_GETFL, 0);
+		return flags >= 0 && fcntl(static_cast<SocketType>(socket), F_SETFL, flags | O_NONBLOCK) == 0;
+	#endif
+}
+
+
+/** Known game by name (as sent in the binary protocol hello), or nullptr */
+static const GameData* findGame(const string_view name) {
+	for (const GameData* game : {&Minecraft, &DummyGame})
+		if (name == game->name) return game;
+	return nullptr;
+}
+
+
+GameBridge::GameBridge(const unsigned short port) : port(port) {
+	listenSocket = static_cast<uintptr_t>(INVALID_SOCKET);
+	pollHandle = static_cast<uintptr_t>(INVALID_SOCKET);
+}
 
 GameBridge::~GameBridge() {
 	closeGameStateListener();
@@ -47,14 +96,18 @@ bool GameBridge::setupSocket() {
 	#endif
 
 	listenSocket = socket(AF_INET, SOCK_STREAM, 0);
-	if (!IS_VALID_SOCKET(listenSocket)) {
+	if (!IS_VALID_SOCKET(static_cast<SocketType>(listenSocket))) {
 		cerr << "[GameBridge] Failed to create socket" << endl;
 		return false;
 	}
 
+	// Allow rebinding right after a restart (the port would otherwise linger in TIME_WAIT)
+	constexpr int reuse = 1;
+	setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
 	sockaddr_in serverAddr{};
 	serverAddr.sin_family = AF_INET;
-	serverAddr.sin_port = htons(PORT);
+	serverAddr.sin_port = htons(port);
 	serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
 	if (bind(listenSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0) {
@@ -62,116 +115,339 @@ bool GameBridge::setupSocket() {
 		return false;
 	}
 
-	if (listen(listenSocket, 1) < 0) {
+	if (listen(listenSocket, LISTEN_BACKLOG) < 0) {
 		cerr << "[GameBridge] Failed to listen" << endl;
 		return false;
 	}
 
+	if (!setNonBlocking(listenSocket)) {
+		cerr << "[GameBridge] Failed to make the listening socket non-blocking" << endl;
+		return false;
+	}
+
+	#ifdef __linux__
+		pollHandle = epoll_create1(0);
+		if (!IS_VALID_SOCKET(static_cast<SocketType>(pollHandle))) {
+			cerr << "[GameBridge] epoll_create1() failed" << endl;
+			return false;
+		}
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = static_cast<SocketType>(listenSocket);
+		epoll_ctl(static_cast<SocketType>(pollHandle), EPOLL_CTL_ADD, static_cast<SocketType>(listenSocket), &event);
+	#endif
+
 	return true;
 }
 
 
-void GameBridge::startGameStateListener() {
+bool GameBridge::startGameStateListener() {
+	listenerClosed = false;
 	if (!setupSocket()) {
-		return;
+		closeGameStateListener();  // Releases whatever was set up
+		return false;
 	}
 
-	thread([this]() {
-		cout << "[GameBridge] Waiting for client on port 5555..." << endl;
-		clientSocket = accept(listenSocket, nullptr, nullptr);
-		if (!IS_VALID_SOCKET(clientSocket)) {
-			cerr << "[GameBridge] Failed to accept client" << endl;
+	running = true;
+	ioThread = thread(&GameBridge::ioLoop, this);
+	cout << "[GameBridge] Waiting for clients on port " << port << "..." << endl;
+	return true;
+}
+
+
+/** Multiplex the listening socket and all clients until the listener is closed */
+void GameBridge::ioLoop() {
+	#ifdef __linux__
+		epoll_event events[64];
+		while (running.load(memory_order_relaxed)) {
+			const int ready = epoll_wait(static_cast<SocketType>(pollHandle), events, size(events), IO_POLL_TIMEOUT_MS);
+			if (ready < 0) {
+				if (errno == EINTR) continue;
+				cerr << "[GameBridge] epoll_wait() error.\n";
+				break;
+			}
+
+			for (int i = 0; i < ready; ++i) {
+				const auto socket = static_cast<uintptr_t>(events[i].data.fd);
+				if (socket == listenSocket) {
+					acceptClients();
+					continue;
+				}
+
+				const auto it = clients.find(socket);
+				if (it != clients.end() && !readClient(it->second))
+					dropClient(socket);
+			}
+		}
+	#else
+		vector<pollfd> fds;
+		vector<uintptr_t> closed;
+		while (running.load(memory_order_relaxed)) {
+			fds.clear();
+			fds.push_back({static_cast<SocketType>(listenSocket), POLLIN, 0});
+			for (const auto& socket : clients | views::keys)
+				fds.push_back({static_cast<SocketType>(socket), POLLIN, 0});
+
+			const int ready = POLL(fds.data(), static_cast<unsigned long>(fds.size()), IO_POLL_TIMEOUT_MS);
+			if (ready < 0) {
+				cerr << "[GameBridge] poll() error.\n";
+				break;
+			}
+			if (ready == 0) continue;
+
+			closed.clear();
+			for (size_t i = 1; i < fds.size(); ++i) {
+				if (fds[i].revents == 0) continue;
+				const auto socket = static_cast<uintptr_t>(fds[i].fd);
+				if (!readClient(clients.at(socket)))
+					closed.push_back(socket);
+			}
+			for (const uintptr_t socket : closed) dropClient(socket);
+
+			if (fds[0].revents & POLLIN) acceptClients();
+		}
+	#endif
+}
+
+
+/** Accept every pending connection (the listening socket is non-blocking) */
+void GameBridge::acceptClients() {
+	while (true) {
+		const SocketType socket = accept(static_cast<SocketType>(listenSocket), nullptr, nullptr);
+		if (!IS_VALID_SOCKET(socket)) {
+			if (!WOULD_BLOCK()) cerr << "[GameBridge] Failed to accept client" << endl;
 			return;
 		}
 
+		if (!setNonBlocking(socket)) {
+			cerr << "[GameBridge] Failed to make the client socket non-blocking" << endl;
+			CLOSESOCKET(socket);
+			continue;
+		}
+
+		#ifdef SO_NOSIGPIPE
+			constexpr int noSigPipe = 1;
+			setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+		#endif
+
+		#ifdef __linux__
+			epoll_event event{};
+			event.events = EPOLLIN | EPOLLRDHUP;
+			event.data.fd = socket;
+			epoll_ctl(static_cast<SocketType>(pollHandle), EPOLL_CTL_ADD, socket, &event);
+		#endif
+
+		clients.emplace(static_cast<uintptr_t>(socket), Client{static_cast<uintptr_t>(socket), nextConnectOrder++});
+
 		{
 			lock_guard lock(connMutex);
-			connected = true;
+			connectedClients = clients.size();
 		}
-
 		connCV.notify_all();
-		cout << "[GameBridge] Client connected" << endl;
+		cout << "[GameBridge] Client connected (" << clients.size() << " connected)" << endl;
+		if (activeClient == INVALID_CLIENT) activate(static_cast<uintptr_t>(socket));
+	}
+}
+
+
+/** Read everything available and queue each complete payload. Returns false once the client is gone */
+bool GameBridge::readClient(Client& client) {
+	while (true) {
+		const span<char> free = client.recvBuffer.writable();
+		if (free.empty()) {
+			// Size limit for protection: the whole ring without a single line break
+			cerr << "[GameBridge] Dropping oversized buffer > " << kMaxBuffer << " bytes\n";
+			client.recvBuffer.clear();
+			continue;
+		}
+
+		const auto rec = recv(static_cast<SocketType>(client.socket), free.data(), static_cast<int>(free.size()), 0);
+		if (rec == 0) return false;  // Orderly shutdown
+		if (rec < 0) {
+			if (INTERRUPTED()) continue;  // Interrupted by a signal before anything was read
+			return WOULD_BLOCK();		  // Drained, or a real error
+		}
 
-	}).detach();
+		// Handle newline-delimited JSON (every line completed by this read), up to a switch to binary frames
+		client.recvBuffer.commit(rec);
+		if (client.format == PayloadFormat::JSON)
+			client.recvBuffer.drainLines([&](const string_view line) { return handleLine(client, line); });
+		if (client.failed) return false;
+
+		if (client.format == PayloadFormat::BINARY) {
+			const bool framed = client.recvBuffer.drainFrames([&](const string_view frame) {
+				if (DEBUG_GB) cout << "[GameBridge] Received frame (" << frame.size() << " bytes)" << endl;
+				pushPayload(client, frame);
+			});
+			if (!framed) {
+				cerr << "[GameBridge] Oversized binary frame, dropping client\n";
+				return false;
+			}
+		}
+	}
 }
 
 
-void GameBridge::waitForConnection() {
-	unique_lock lock(connMutex);
-	connCV.wait(lock, [this] {
-		return connected.load();
-	});
+/** Queue a JSON line, or negotiate the protocol. Returns false once the client switched to binary frames */
+bool GameBridge::handleLine(Client& client, const string_view line) {
+	if (line.starts_with(GameStateProtocol::HELLO)) {
+		negotiate(client, line);
+		return client.format == PayloadFormat::JSON && !client.failed;
+	}
+
+	if (DEBUG_GB) cout << "[GameBridge] Received JSON: " << line << endl;
+	pushPayload(client, line);
+	return true;
 }
 
-bool GameBridge::isClientConnected() const {
-	return connected.load();
+
+/** Switch the client to binary frames if it asks for them and its game is known, and acknowledge the protocol */
+void GameBridge::negotiate(Client& client, const string_view hello) {
+	try {
+		const auto parsed = nlohmann::json::parse(hello).at("hello");
+		if (parsed.value("protocol", "") == "binary")
+			client.game = findGame(parsed.value("game", ""));
+	} catch (const exception& e) {
+		cerr << "[GameBridge] Malformed hello: " << e.what() << endl;
+	}
+
+	client.format = client.game ? PayloadFormat::BINARY : PayloadFormat::JSON;
+	const string_view ack = client.game ? GameStateProtocol::ACK_BINARY : GameStateProtocol::ACK_JSON;
+	// The ack is tiny, so a non-blocking send only comes up short if the client is gone or not reading at all
+	if (send(static_cast<SocketType>(client.socket), ack.data(), static_cast<int>(ack.size()), SEND_FLAGS) != static_cast<int>(ack.size())) {
+		cerr << "[GameBridge] Failed to acknowledge the protocol, dropping client" << endl;
+		client.failed = true;
+		return;
+	}
+
+	cout << "[GameBridge] Client uses the " << (client.game ? "binary" : "JSON") << " protocol" << endl;
 }
 
 
-string GameBridge::receiveJsonPayload() {
-	if (!isClientConnected()) return "";
+void GameBridge::dropClient(const uintptr_t socket) {
+	#ifdef __linux__
+		epoll_ctl(static_cast<SocketType>(pollHandle), EPOLL_CTL_DEL, static_cast<SocketType>(socket), nullptr);
+	#endif
+	CLOSESOCKET(static_cast<SocketType>(socket));
+	clients.erase(socket);
 
-	char chunk[4096];
+	// Hand over to the client that has waited longest
+	if (socket == activeClient) {
+		const auto next = ranges::min_element(clients, {}, [](const auto& entry) { return entry.second.connectOrder; });
+		activate(next != clients.end() ? next->first : INVALID_CLIENT);
+	}
 
-	while (true) {
-		fd_set readSet;
-		FD_ZERO(&readSet);
-		FD_SET(clientSocket, &readSet);
-
-		timeval timeout{};
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 150000;  // Wait 150 ms
-
-		const int sel = select(static_cast<int>(clientSocket) + 1, &readSet, nullptr, nullptr, &timeout);
-		if (sel == 0) return "";  // Timeout: No data received for 150 ms
-		if (sel < 0) {
-			cerr << "[GameBridge] select() error.\n";
-			connected = false;
-			return "";
-		}
+	{
+		lock_guard lock(connMutex);
+		connectedClients = clients.size();
+	}
+	connCV.notify_all();
+	inboxCV.notify_all();  // Let a waiting receiver notice the disconnect right away
+	cout << "[GameBridge] Client disconnected (" << clients.size() << " connected).\n";
+}
 
-		const int rec = recv(clientSocket, chunk, sizeof(chunk) - 1, 0);
-		if (rec <= 0) {
-			cout << "[GameBridge] Client disconnected.\n";
-			connected = false;
-			return "";
-		}
 
-		recvBuffer.append(chunk, rec);
+/** Make `socket` the client whose states are played, discarding states still queued from the previous one */
+void GameBridge::activate(const uintptr_t socket) {
+	activeClient = socket;
+	{
+		lock_guard lock(inboxMutex);
+		inbox.clear();
+	}
+	if (socket != INVALID_CLIENT)
+		cout << "[GameBridge] Playing the states of client " << clients.at(socket).connectOrder << endl;
+}
 
-		// Size limit for protection
-		if (recvBuffer.size() > kMaxBuffer) {
-			cerr << "[GameBridge] Dropping oversized buffer > " << kMaxBuffer << " bytes\n";
-			recvBuffer.clear();
-			return "";
-		}
+void GameBridge::pushPayload(Client& client, const string_view data) {
+	if (data.empty()) return;  // Would read as a timeout
 
-		// Handle newline-delimited JSON
-		const size_t nl = recvBuffer.find('\n');
-		if (nl != string::npos) {
-			string line = recvBuffer.substr(0, nl);
-			recvBuffer.erase(0, nl + 1);
-			if (DEBUG_GB) cout << "[GameBridge] Received JSON: " << line << endl;
-			return line;
-		}
+	// Only one game drives the music: interleaving the states of several would flip it on every update
+	if (client.socket != activeClient) {
+		if (!client.ignoredNotified)
+			cout << "[GameBridge] Ignoring client " << client.connectOrder << " until the active client disconnects" << endl;
+		client.ignoredNotified = true;
+		return;
+	}
+
+	{
+		lock_guard lock(inboxMutex);
+		if (inbox.size() >= kMaxInbox) inbox.pop_front();
+		inbox.push_back({client.format, string(data), client.game});
 	}
+	inboxCV.notify_one();
 }
 
 
-void GameBridge::closeGameStateListener() {
-	if (IS_VALID_SOCKET(clientSocket)) {
-		CLOSESOCKET(clientSocket);
-		clientSocket = INVALID_SOCKET;
+/** Blocks until a client connected (true) or the listener was closed (false) */
+bool GameBridge::waitForConnection() {
+	unique_lock lock(connMutex);
+	connCV.wait(lock, [this] {
+		return connectedClients.load() > 0 || listenerClosed.load();
+	});
+	return connectedClients.load() > 0;
+}
+
+void GameBridge::stopWaitingForConnection() {
+	{
+		lock_guard lock(connMutex);
+		listenerClosed = true;
 	}
+	connCV.notify_all();
+	inboxCV.notify_all();
+}
+
+bool GameBridge::isClientConnected() const {
+	return connectedClients.load() > 0;
+}
+
+size_t GameBridge::clientCount() const {
+	return connectedClients.load();
+}
+
+
+/**
+ * Returns the next payload from any client, or an empty one if nothing arrived within the timeout,
+ * the last client disconnected or the listener was closed
+ */
+GamePayload GameBridge::receivePayload(const int timeoutMs) {
+	unique_lock lock(inboxMutex);
+	inboxCV.wait_for(lock, chrono::milliseconds(timeoutMs), [this] {
+		return !inbox.empty() || !isClientConnected() || listenerClosed.load();
+	});
+	if (inbox.empty()) return {};
+
+	GamePayload payload = std::move(inbox.front());
+	inbox.pop_front();
+	return payload;
+}
+
+
+void GameBridge::closeGameStateListener() {
+	running = false;
+	if (ioThread.joinable()) ioThread.join();
+
+	for (const auto& socket : clients | views::keys)
+		CLOSESOCKET(static_cast<SocketType>(socket));
+	clients.clear();
+	activeClient = INVALID_CLIENT;
+
+	#ifdef __linux__
+		if (IS_VALID_SOCKET(static_cast<SocketType>(pollHandle))) {
+			CLOSESOCKET(static_cast<SocketType>(pollHandle));
+			pollHandle = static_cast<uintptr_t>(INVALID_SOCKET);
+		}
+	#endif
 
-	if (IS_VALID_SOCKET(listenSocket)) {
-		CLOSESOCKET(listenSocket);
-		listenSocket = INVALID_SOCKET;
+	const bool wasListening = IS_VALID_SOCKET(static_cast<SocketType>(listenSocket));
+	if (wasListening) {
+		CLOSESOCKET(static_cast<SocketType>(listenSocket));
+		listenSocket = static_cast<uintptr_t>(INVALID_SOCKET);
 	}
 
-	connected = false;
+	connectedClients = 0;
+	stopWaitingForConnection();
 
 	#ifdef _WIN32
-		WSACleanup();
+		if (wasListening) WSACleanup();
 	#endif
 }
@@ -1,34 +1,101 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 
+#include "../util/LineRing.h"
 
+struct GameData;
+
+
+/** How a payload is encoded: JSON line, or a binary frame (see GameStateProtocol.h) after the client negotiated it */
+enum class PayloadFormat {
+	JSON,
+	BINARY
+};
+
+struct GamePayload {
+	PayloadFormat format = PayloadFormat::JSON;
+	std::string data;				// JSON line, or binary frame without its length prefix
+	const GameData* game = nullptr;	// Resolves the IDs of binary frames
+
+	[[nodiscard]] bool empty() const { return data.empty(); }
+};
+
+
+/**
+ * Socket server the games send their states to. A single I/O thread multiplexes the listening socket
+ * and every client (epoll on Linux, poll/WSAPoll elsewhere) with non-blocking reads,
+ * so any number of game instances can connect, disconnect and reconnect while the engine keeps running.
+ * Only the client that connected first is played: its complete payloads are queued and handed out by
+ * receivePayload(). Further clients stay connected but are ignored until the active one disconnects.
+ */
 class GameBridge {
 public:
-	GameBridge();
+	explicit GameBridge(unsigned short port = 5555);
 	~GameBridge();
 
-	void startGameStateListener();
+	bool startGameStateListener();  // False if the port can't be listened on
 	void closeGameStateListener();
 
-	void waitForConnection();
+	bool waitForConnection();
 	[[nodiscard]] bool isClientConnected() const;
+	[[nodiscard]] size_t clientCount() const;
 
-	std::string receiveJsonPayload();
+	GamePayload receivePayload(int timeoutMs = 150);
 
 private:
+	static constexpr size_t kMaxBuffer = 256 * 1024;	// 256 KB protection (per client): longest possible line
+	static constexpr size_t kMaxInbox  = 1024;			// Oldest states are dropped beyond this (newer ones supersede them)
+
+	static constexpr uintptr_t INVALID_CLIENT = UINTPTR_MAX;
+
+	struct Client {
+		uintptr_t socket;
+		uint64_t connectOrder;			  // Who takes over when the active client disconnects
+		bool ignoredNotified = false;	  // Told once that its states are ignored
+		LineRing<kMaxBuffer> recvBuffer;  // persistent buffer for line framing, received into directly
+		PayloadFormat format = PayloadFormat::JSON;
+		const GameData* game = nullptr;
+		bool failed = false;  // Protocol negotiation failed, drop it
+	};
+
 	std::mutex connMutex;
 	std::condition_variable connCV;
-	std::atomic<bool> connected{false};
+	std::atomic<size_t> connectedClients{0};
+	std::atomic<bool> listenerClosed{false};  // Wakes up waitForConnection() when no client will come anymore
+
+	unsigned short port;
 
 	uintptr_t listenSocket = 0;
-	uintptr_t clientSocket = 0;
+	uintptr_t pollHandle = 0;	// epoll instance (Linux only)
+	std::thread ioThread;
+	std::atomic<bool> running{false};
+
+	std::unordered_map<uintptr_t, Client> clients;  // Owned by the I/O thread
+	uintptr_t activeClient = INVALID_CLIENT;		// The one whose payloads are queued (I/O thread)
+	uint64_t nextConnectOrder = 0;
 
-	std::string recvBuffer;								// persistent buffer for line framing
-	static constexpr size_t kMaxBuffer = 256 * 1024;	// 256 KB protection
+	// Complete payloads, waiting for receivePayload()
+	std::mutex inboxMutex;
+	std::condition_variable inboxCV;
+	std::deque<GamePayload> inbox;
 
 	bool setupSocket();
+	void stopWaitingForConnection();
+
+	void ioLoop();
+	void acceptClients();
+	bool readClient(Client& client);
+	void dropClient(uintptr_t socket);
+	bool handleLine(Client& client, std::string_view line);
+	void negotiate(Client& client, std::string_view hello);
+	void activate(uintptr_t socket);
+	void pushPayload(Client& client, std::string_view data);
 };
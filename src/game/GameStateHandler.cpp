@@ -1,42 +1,74 @@
 #include "MusicMaker.h"
+#include "GameData.h"
 
 using namespace std;
 using namespace sol;
 
 
+constexpr int ACTIVE_TIMEOUT_MS = 150;   // No update for this long while playing -> game is considered paused
+constexpr int PAUSED_TIMEOUT_MS = 1000;  // Receive timeout while paused (only bounds how fast a stop is noticed)
+
+
 void MusicMaker::startGameStateThread() {
-	std::thread([this] {
-		while (!stopReceiver.load() && gb.isClientConnected()) {
-			string payload = gb.receiveJsonPayload();
-			if (payload.empty()) {
-				if (gb.isClientConnected()) {
-					// Client still connected -> Game paused
-					pause();
-				}
-				continue;
+	gameStateThread = std::thread([this] {
+		GameStateProtocol::GameState binaryState;  // Reused for every binary frame
+
+		while (!stopReceiver.load()) {
+			// (Re)connect: playback stays paused until a game is connected again
+			if (!gb.isClientConnected()) {
+				if (!gb.waitForConnection()) break;  // Listener closed before a client came
+				clientSeen = true;
+				wakePlayback();
 			}
 
-			if (isPaused) {
-				isPaused = false;
-				resume();
+			const GamePayload payload = gb.receivePayload(isPaused ? PAUSED_TIMEOUT_MS : ACTIVE_TIMEOUT_MS);
+			if (payload.empty()) {
+				// Client silent (game paused) or gone (waiting for a reconnect)
+				pause();
+				continue;
 			}
 
 			try {
-				nlohmann::json parsed = nlohmann::json::parse(payload);
-
 				// Convert to Lua table
 				table gameState = lua.create_table();
+				bool paused;
+
+				if (payload.format == PayloadFormat::BINARY) {
+					// Decoded straight into the Lua table, no JSON document in between
+					if (!GameStateProtocol::decode(payload.data, binaryState)) {
+						cerr << "[MusicMaker] Malformed binary game state (" << payload.data.size() << " bytes)\n";
+						continue;
+					}
+					paused = binaryState.paused;
+					if (!paused) handleGameState(binaryState, *payload.game, gameState);
+				} else {
+					nlohmann::json parsed = nlohmann::json::parse(payload.data);
+					const auto it = parsed.find("paused");
+					paused = it != parsed.end() && it->is_boolean() && it->get<bool>();
+					if (!paused) handleGameState(parsed, gameState);
+				}
+
+				// Explicit pause state sent by the game
+				if (paused) {
+					pause();
+					continue;
+				}
 
-				handleGameState(parsed, gameState);
+				resume();
 
 				// Call on_update
 				onUpdate(gameState);
+				publishMusicState();
 
 			} catch (const exception& e) {
-				cerr << "[MusicMaker] JSON parse error: " << e.what() << endl;
+				const bool binary = payload.format == PayloadFormat::BINARY;
+				cerr << "[MusicMaker] " << (binary ? "Binary game state error: " : "JSON parse error: ") << e.what() << endl;
 			}
 		}
-	}).detach();
+
+		// Let the play loop notice the stop right away
+		wakePlayback();
+	});
 }
 
 
@@ -136,3 +168,43 @@ void MusicMaker::handleGameState(nlohmann::json& parsed, table& gameState) {
     	gameState["environmentTags"] = tagsTbl;
 	}
 }
+
+
+/** Same as for JSON, but the mobs, environment and tags arrive as indices into the game's lists */
+void MusicMaker::handleGameState(const GameStateProtocol::GameState& state, const GameData& game, table& gameState) {
+	auto lookup = [](const vector<string>& list, const size_t id) -> const string* {
+		return id < list.size() ? &list[id] : nullptr;
+	};
+
+	// playerHealth
+	double hp = state.playerHealth;
+	if (!(hp >= 0.0 && hp <= 1.0)) {  // Also catches NaN
+		cerr << "[MusicMaker] Binary: playerHealth out of range -> clamped\n";
+		hp = isnan(hp) ? 1.0 : clamp(hp, 0.0, 1.0);
+	}
+	gameState["playerHealth"] = hp;
+
+	// enemies (at most GameStateProtocol::MAX_ENEMIES, enforced by decode())
+	table enemies = lua.create_table();
+	size_t written = 0;
+	for (const auto& [mob, distance] : state.enemies) {
+		const string* type = lookup(game.mobsList, mob);
+		if (!type) continue;
+
+		table e = lua.create_table();
+		e["type"] = *type;
+		e["distance"] = distance >= 0.0f ? static_cast<double>(distance) : 0.0;  // Also catches NaN
+		enemies[++written] = e;
+	}
+	gameState["enemies"] = enemies;
+
+	// environment
+	table tagsTbl = lua.create_table();
+	size_t i = 0;
+	for (const uint8_t tag : state.tags)
+		if (const string* name = lookup(game.tagsList, tag)) tagsTbl[++i] = *name;
+
+	const string* env = lookup(game.envList, state.environment);
+	gameState["environment"]     = env ? *env : string();
+	gameState["environmentTags"] = tagsTbl;
+}
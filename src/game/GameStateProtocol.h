@@ -0,0 +1,106 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * Compact binary alternative to the newline-delimited JSON game states, negotiated per client:
+ * the client sends a hello line ({"hello":{"protocol":"binary","game":"Minecraft"}}) and, once the bridge
+ * acknowledged it with {"protocol":"binary"}, switches to length-prefixed frames. Mobs, environments and tags
+ * are sent as their indices into the game's GameData lists instead of strings. Without the acknowledgement
+ * (unknown game, older engine) the client keeps sending JSON. All values are little-endian:
+ *
+ *	u32 length			of the rest of the frame
+ *	u8  flags			bit 0: paused
+ *	f32 playerHealth
+ *	u16 environment		NO_ID: none
+ *	u8  tagCount,   u8 tag[tagCount]
+ *	u16 enemyCount, {u16 mob, f32 distance}[enemyCount]
+ */
+namespace GameStateProtocol {
+	static_assert(std::endian::native == std::endian::little, "Frames are read and written in host byte order");
+
+	constexpr uint16_t NO_ID = 0xFFFF;
+	constexpr size_t LENGTH_BYTES = 4;
+	constexpr size_t MAX_ENEMIES = 256;		// Same limit as for JSON game states
+	constexpr std::string_view HELLO = R"({"hello")";
+	constexpr std::string_view ACK_BINARY = "{\"protocol\":\"binary\"}\n";
+	constexpr std::string_view ACK_JSON = "{\"protocol\":\"json\"}\n";
+
+	struct Enemy {
+		uint16_t mob;
+		float distance;
+	};
+
+	struct GameState {
+		bool paused = false;
+		float playerHealth = 1.0f;
+		uint16_t environment = NO_ID;
+		std::vector<uint8_t> tags;
+		std::vector<Enemy> enemies;
+	};
+
+
+	template<typename T>
+	void put(std::string& out, const T value) {
+		out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	bool get(std::string_view& in, T& value) {
+		if (in.size() < sizeof(T)) return false;
+		std::memcpy(&value, in.data(), sizeof(T));
+		in.remove_prefix(sizeof(T));
+		return true;
+	}
+
+
+	/** Append the state as one frame, including its length prefix */
+	inline void encode(const GameState& state, std::string& out) {
+		const size_t start = out.size();
+		put<uint32_t>(out, 0);  // Patched below
+
+		put<uint8_t>(out, state.paused ? 1 : 0);
+		put<float>(out, state.playerHealth);
+		put<uint16_t>(out, state.environment);
+
+		const size_t tagCount = std::min<size_t>(state.tags.size(), UINT8_MAX);
+		put<uint8_t>(out, static_cast<uint8_t>(tagCount));
+		out.append(reinterpret_cast<const char*>(state.tags.data()), tagCount);
+
+		const size_t enemyCount = std::min(state.enemies.size(), MAX_ENEMIES);
+		put<uint16_t>(out, static_cast<uint16_t>(enemyCount));
+		for (size_t i = 0; i < enemyCount; ++i) {
+			put<uint16_t>(out, state.enemies[i].mob);
+			put<float>(out, state.enemies[i].distance);
+		}
+
+		const auto length = static_cast<uint32_t>(out.size() - start - LENGTH_BYTES);
+		std::memcpy(out.data() + start, &length, LENGTH_BYTES);
+	}
+
+	/** Decode a frame (without its length prefix) into `state`, reusing its vectors. False if the frame is malformed */
+	inline bool decode(std::string_view frame, GameState& state) {
+		uint8_t flags, tagCount;
+		uint16_t enemyCount;
+
+		if (!get(frame, flags) || !get(frame, state.playerHealth) || !get(frame, state.environment)) return false;
+		state.paused = flags & 1;
+
+		if (!get(frame, tagCount) || frame.size() < tagCount) return false;
+		state.tags.assign(frame.begin(), frame.begin() + tagCount);
+		frame.remove_prefix(tagCount);
+
+		if (!get(frame, enemyCount) || enemyCount > MAX_ENEMIES) return false;
+		state.enemies.resize(enemyCount);
+		for (auto& [mob, distance] : state.enemies)
+			if (!get(frame, mob) || !get(frame, distance)) return false;
+
+		return frame.empty();
+	}
+}
@@ -177,9 +177,11 @@ void GUI::start() {
 
 void GUI::stopMusicIfRunning() {
 	if (musicRunning.load(memory_order_acquire)) {
-		if (music) music->requestStop();
-		if (musicThread.joinable()) musicThread.join();
-		music.reset();
+		if (sessionHost && sessionId >= 0) {
+			sessionHost->stopSession(sessionId);
+			sessionHost->waitForSession(sessionId);
+		}
+		sessionId = -1;
 		musicRunning.store(false, memory_order_release);
 		musicPaused.store(false, memory_order_release);
 	}
@@ -10,6 +10,7 @@
 #include "GLFW/glfw3.h"
 
 #include "MusicMaker.h"
+#include "engine/SessionHost.h"
 #include "game/GameData.h"
 #include "game/Rule.h"
 #include "GUILogger.h"
@@ -37,8 +38,8 @@ private:
 	GLFWwindow* window = nullptr;
 
 	// MusicGen runtime
-	std::unique_ptr<MusicMaker> music;
-	std::thread musicThread;
+	std::unique_ptr<SessionHost> sessionHost;  // Created on the first start
+	int sessionId = -1;
 	std::atomic<bool> musicRunning{false};
 	std::atomic<bool> musicPaused{false};
 
@@ -570,13 +570,12 @@ void GUI::ruleDef() {
 		// Make sure any previous run is shut down
 		stopMusicIfRunning();
 
-		// Start fresh MusicMaker in the background
-		music = make_unique<MusicMaker>();
+		// Start a fresh session in the background (prepared and played by the host's worker threads)
+		if (!sessionHost) sessionHost = make_unique<SessionHost>();
 		musicRunning.store(true, memory_order_release);
 		musicPaused.store(false, memory_order_release);
-
-		musicThread = thread([this]{
-			music->start();                  // blocking in this worker thread
+		sessionId = sessionHost->addSession({}, [this] {
+			// Also when the session ends by itself (e.g. it failed), not only via stopMusicIfRunning()
 			musicRunning.store(false, memory_order_release);
 			musicPaused.store(false, memory_order_release);
 		});
@@ -0,0 +1,125 @@
+#include "LiveMIDIInput.h"
+
+using namespace std;
+
+
+LiveMIDIInput::LiveMIDIInput(const MarkovChain& seed, const int markovChainOrder, const TimeSignatureInfo& tsInfo)
+	: chain(seed), buffer(markovChainOrder + 1), tsInfo(tsInfo) {  // + 1 for next note (training)
+	buffer.fill(make_shared<SimpleEvent>(START));
+}
+
+LiveMIDIInput::~LiveMIDIInput() {
+	close();
+}
+
+
+bool LiveMIDIInput::open(const unsigned port) {
+	try {
+		midiIn = make_unique<RtMidiIn>();
+	} catch (RtMidiError& error) {
+		error.printMessage();
+		return false;
+	}
+
+	const unsigned int nPorts = midiIn->getPortCount();
+	if (port >= nPorts) {
+		cerr << "[LiveMIDIInput] MIDI input port " << port << " not available (" << nPorts << " ports)\n";
+		midiIn.reset();
+		return false;
+	}
+	cout << "[LiveMIDIInput] Training from " << midiIn->getPortName(port) << endl;
+
+	recordStart = lastNoteEnd = Clock::now();
+	consumer = thread([this] { consumerLoop(); });
+
+	midiIn->ignoreTypes(true, true, true);  // No SysEx, timing or active sensing
+	midiIn->setCallback(&LiveMIDIInput::onMessage, this);
+	midiIn->openPort(port);
+	return true;
+}
+
+void LiveMIDIInput::close() {
+	if (midiIn) {
+		midiIn->cancelCallback();
+		if (midiIn->isPortOpen()) midiIn->closePort();
+		midiIn.reset();
+	}
+
+	if (!consumer.joinable()) return;
+	stopping.store(true, memory_order_release);
+	wakeConsumer();
+	consumer.join();
+
+	if (const uint64_t lost = droppedCount(); lost > 0)
+		cerr << "[LiveMIDIInput] " << lost << " input messages were dropped\n";
+}
+
+
+/** RtMidi's input thread: no locks, no allocations, only hands the message over */
+void LiveMIDIInput::onMessage(double /*deltaTime*/, vector<unsigned char>* message, void* userData) {
+	auto* self = static_cast<LiveMIDIInput*>(userData);
+	if (message->size() < 3) return;  // Only note on/off matter
+
+	const RawMessage raw{Clock::now(), (*message)[0], (*message)[1], (*message)[2]};
+	if (!self->queue.push(raw)) {
+		self->dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	self->wakeConsumer();
+}
+
+void LiveMIDIInput::wakeConsumer() {
+	wakeups.fetch_add(1, memory_order_release);
+	wakeups.notify_one();
+}
+
+
+void LiveMIDIInput::consumerLoop() {
+	while (!stopping.load(memory_order_acquire)) {
+		const uint32_t seen = wakeups.load(memory_order_acquire);  // Anything after this wakes up the wait below
+
+		while (const auto message = queue.pop())
+			handleMessage(*message);
+
+		// Publish a snapshot for playback, the chain itself keeps being trained here
+		if (snapshotRequested.exchange(false, memory_order_relaxed) && trainedSinceSnapshot) {
+			published.store(make_shared<const MarkovChain>(chain), memory_order_release);
+			trainedSinceSnapshot = false;
+		}
+
+		wakeups.wait(seen, memory_order_acquire);
+	}
+}
+
+/** Pair note-ons with their note-offs, a melody event is complete once its key is released */
+void LiveMIDIInput::handleMessage(const RawMessage& message) {
+	const int type	= MSG_TYPE(message.status);
+	const Note note = message.data1 & 0x7F;
+
+	if (type == NOTE_ON && message.data2 > 0) {
+		noteStarts[note] = message.time;
+		return;
+	}
+	if (type != NOTE_OFF && type != NOTE_ON) return;  // NOTE_ON with velocity 0 is a note-off
+
+	const Clock::time_point start = noteStarts[note];
+	if (start == Clock::time_point{}) return;  // Pressed before the input was opened
+	noteStarts[note] = {};
+
+	// Durations in µs, like the events trained from MIDI files
+	const double gap = chrono::duration<double, micro>(start - lastNoteEnd).count();
+	if (gap > MIN_PAUSE_LENGTH)
+		train(PAUSE, lastNoteEnd, gap);
+
+	train(note, start, chrono::duration<double, micro>(message.time - start).count());
+	lastNoteEnd = max(lastNoteEnd, message.time);
+
+	trainedSinceSnapshot = true;
+	notes.fetch_add(1, memory_order_relaxed);
+}
+
+void LiveMIDIInput::train(const Note note, const Clock::time_point start, const double duration) {
+	const auto event = make_shared<FixedEvent>(note, getMTP(recordStart, start, tsInfo), duration);
+	buffer.push(event);
+	chain.iatp(buffer, event);
+}
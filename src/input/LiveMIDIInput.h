@@ -0,0 +1,81 @@
+#pragma once
+
+#include <RtMidi.h>
+
+#include "data/MarkovChain.h"
+#include "util/SPSCQueue.h"
+#include "util/Timing.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+
+/**
+ * Trains a Markov chain incrementally from a live MIDI keyboard while the session plays.
+ * The RtMidi callback only timestamps the raw message and pushes it to a lock-free ring, so input latency
+ * doesn't depend on the model size. A consumer thread, woken for every message, turns complete notes into FixedEvents
+ * and trains the chain with them. Copying the chain costs O(chain size), so a snapshot is only published when
+ * the playback side asks for one (once per measure) and notes were trained since the last one.
+ */
+class LiveMIDIInput {
+public:
+	LiveMIDIInput(const MarkovChain& seed, int markovChainOrder, const TimeSignatureInfo& tsInfo);
+	~LiveMIDIInput();
+
+	LiveMIDIInput(const LiveMIDIInput&) = delete;
+	LiveMIDIInput& operator=(const LiveMIDIInput&) = delete;
+
+	/** Open the input port and start training, false if there is no such port */
+	bool open(unsigned port = 0);
+	void close();
+
+	/** Most recently published chain (nullptr until then), and request a new snapshot for the next call */
+	[[nodiscard]] std::shared_ptr<const MarkovChain> latestChain() {
+		snapshotRequested.store(true, std::memory_order_relaxed);
+		wakeConsumer();
+		return published.load(std::memory_order_acquire);
+	}
+
+	[[nodiscard]] uint64_t noteCount() const { return notes.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t QUEUE_CAPACITY = 1024;
+
+	struct RawMessage {
+		Clock::time_point time;
+		unsigned char status;
+		unsigned char data1;
+		unsigned char data2;
+	};
+
+	std::unique_ptr<RtMidiIn> midiIn;
+	SPSCQueue<RawMessage, QUEUE_CAPACITY> queue;
+	std::atomic<uint64_t> dropped{0};
+
+	// Consumer thread only
+	MarkovChain chain;
+	FixedQueue buffer;
+	TimeSignatureInfo tsInfo;
+	Clock::time_point recordStart;
+	Clock::time_point lastNoteEnd;
+	std::array<Clock::time_point, 128> noteStarts{};  // Start of each sounding key, empty if not sounding
+	bool trainedSinceSnapshot = false;
+
+	std::atomic<std::shared_ptr<const MarkovChain>> published;
+	std::atomic<bool> snapshotRequested{false};
+	std::atomic<uint32_t> wakeups{0};  // Bumped for every message, snapshot request and stop, the consumer waits on it
+	std::atomic<uint64_t> notes{0};
+
+	std::atomic<bool> stopping{false};
+	std::thread consumer;
+
+	static void onMessage(double deltaTime, std::vector<unsigned char>* message, void* userData);
+
+	void wakeConsumer();
+	void consumerLoop();
+	void handleMessage(const RawMessage& message);
+	void train(Note note, Clock::time_point start, double duration);
+};
@@ -54,6 +54,25 @@ void MusicMaker::bindMusicFunctions() {
 	});
 
 
+	// SYNTH
+	// set_synth (only in the rules file, the synth starts right after it)
+	musicTable.set_function("set_synth", [this](const table& options) {
+		SynthSettings settings = config.synth;
+		settings.cpuCores	= clamp(options.get_or("cpu_cores", settings.cpuCores), 1, 256);
+		settings.periodSize = max(options.get_or("period_size", settings.periodSize), 0);
+		settings.periods	= max(options.get_or("periods", settings.periods), 0);
+		settings.polyphony	= max(options.get_or("polyphony", settings.polyphony), 0);
+		settings.sampleRate = max(options.get_or("sample_rate", settings.sampleRate), 0.0);
+		settings.dynamicSampleLoading = options.get_or("dynamic_sample_loading", settings.dynamicSampleLoading);
+		config.synth = settings;  // Read by prepare() when loading the soundfont
+		midi.configure(settings);
+		cout << "[Lua] Set synth to " << settings.cpuCores << " cores, period size " << settings.periodSize
+			 << " x " << settings.periods << ", polyphony " << settings.polyphony
+			 << ", sample rate " << settings.sampleRate << " (0 = default)"
+			 << (settings.dynamicSampleLoading ? ", dynamic sample loading" : "") << "\n";
+	});
+
+
 	// EFFECTS
 	// set_intensity
 	musicTable.set_function("set_intensity", [this](const double intensity) {
@@ -80,8 +99,9 @@ void MusicMaker::bindMusicFunctions() {
 
 	// set_lead_style
 	musicTable.set_function("set_lead_style", [this](const string& style) {
-		if (style == musicState.leadStyle) return;
-		musicState.leadStyle = style;
+		const LeadStyle parsed = getLeadStyle(style);
+		if (parsed == musicState.leadStyle) return;
+		musicState.leadStyle = parsed;
 		cout << "[Lua] Set lead style to \"" << style << "\"\n";
 	});
 
@@ -101,8 +121,9 @@ void MusicMaker::bindMusicFunctions() {
 
 	// set_bass_style
 	musicTable.set_function("set_bass_style", [this](const string& style) {
-		if (style == musicState.bassStyle) return;
-		musicState.bassStyle = style;
+		const BassStyle parsed = getBassStyle(style);
+		if (parsed == musicState.bassStyle) return;
+		musicState.bassStyle = parsed;
 		cout << "[Lua] Set bass style to \"" << style << "\"\n";
 	});
 
@@ -113,6 +134,68 @@ void MusicMaker::bindMusicFunctions() {
 		musicState.drumPattern = parsed;
 		cout << "[Lua] Set drum pattern to \"" << patternName << "\"\n";
 	});
+
+	// define_drum_pattern
+	// e.g. music.define_drum_pattern("Combat", "7/8", { {note = 36, beats = {0, 2, 4}, velocity = 110}, ... })
+	// Definitions can also be kept in separate files and loaded with dofile() from rules.lua
+	// Patterns are compiled for the input's meter after on_start, so they must be defined while loading or in on_start
+	musicTable.set_function("define_drum_pattern", [this](const string& patternName, const string& meter, const table& hits) {
+		if (drumPatternsCompiled) {
+			cerr << "[Lua] define_drum_pattern: \"" << patternName << "\" rejected, drum patterns must be defined while loading or in on_start\n";
+			return;
+		}
+
+		const DrumPattern pattern = getDrumPattern(patternName);
+		const auto [num, denom] = parseMeter(meter);
+
+		vector<DrumHit> parsed;
+		hits.for_each([&](const object&, const object& value) {
+			if (value.get_type() != type::table) {
+				cerr << "[Lua] define_drum_pattern: skipping malformed hit entry\n";
+				return;
+			}
+
+			const auto hit = value.as<table>();
+			const int note = hit.get_or("note", -1);
+			const int velocity = clamp(hit.get_or("velocity", DRUMS.velocity), 1, 127);
+			if (note < 0 || note > 127) {
+				cerr << "[Lua] define_drum_pattern: invalid note " << note << " ignored\n";
+				return;
+			}
+
+			const object beats = hit["beats"];
+			if (beats.get_type() != type::table) {
+				cerr << "[Lua] define_drum_pattern: skipping hit without a beats table\n";
+				return;
+			}
+
+			beats.as<table>().for_each([&](const object&, const object& beat) {
+				if (!beat.is<double>()) {
+					cerr << "[Lua] define_drum_pattern: skipping malformed beat entry\n";
+					return;
+				}
+
+				const auto offset = beat.as<double>();
+				if (offset < 0.0 || offset >= num) {
+					cerr << "[Lua] define_drum_pattern: beat " << offset << " outside of " << meter << " ignored\n";
+					return;
+				}
+				parsed.push_back({offset, static_cast<Note>(note), velocity});
+			});
+		});
+
+		drumPatternLibrary.define(pattern, num, denom, move(parsed));
+		cout << "[Lua] Defined drum pattern \"" << patternName << "\" for " << meter << "\n";
+	});
+}
+
+
+/** Publish the state written by the Lua setters to the play loop (call after each batch of Lua calls) */
+void MusicMaker::publishMusicState() {
+	MusicSnapshot& snapshot = musicSnapshots.back();
+	snapshot.state = musicState;
+	snapshot.themes.assign(activeThemes.begin(), activeThemes.end());
+	musicSnapshots.publish();
 }
 
 
@@ -127,11 +210,11 @@ void MusicMaker::loadLuaFileSafe(const string& path, const char* tag) {
 }
 
 void MusicMaker::loadLuaRules() {
-	loadLuaFileSafe("lua/rules.lua", "rules.lua");
+	loadLuaFileSafe(config.rulesPath, "rules.lua");
 }
 
 void MusicMaker::loadLuaLogic() {
-	loadLuaFileSafe("lua/logic.lua", "logic.lua");
+	loadLuaFileSafe(config.logicPath, "logic.lua");
 
 	onStart  = lua["on_start"];
 	onUpdate = lua["on_update"];
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../data/Style.h"
+
 #include <unordered_set>
 #include <string>
 
@@ -26,16 +28,9 @@ static const std::unordered_set<std::string> kScales = {
 	"Locrian"
 };
 
-static const std::unordered_set<std::string> kLeadStyles = {
-	"Sustain",
-	"Pulse"
-};
-
-static const std::unordered_set<std::string> kBassStyles = {
-	"Sustain",
-	"Pulse",
-	"Fast"
-};
+// Same names the Lua setters parse (see data/Style.h)
+static const std::unordered_set<std::string> kLeadStyles(leadStyleNames.begin(), leadStyleNames.end());
+static const std::unordered_set<std::string> kBassStyles(bassStyleNames.begin(), bassStyleNames.end());
 
 static const std::unordered_set<std::string> kDrumPatterns = {
 	"None",
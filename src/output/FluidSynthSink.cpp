@@ -0,0 +1,218 @@
+#include "FluidSynthSink.h"
+
+using namespace std;
+
+
+FluidSynthSink::FluidSynthSink(const SynthSettings& synthSettings) : synthSettings(synthSettings) {
+	for (auto& program : programs) program.store(-1, memory_order_relaxed);
+}
+
+FluidSynthSink::~FluidSynthSink() {
+	if (!started.load(memory_order_acquire)) return;
+	if (adriver && overflowCommandCount() > 0)
+		cerr << "[FluidSynthSink] " << overflowCommandCount() << " commands overflowed the queue\n";
+
+	delete_fluid_audio_driver(adriver);
+	if (sharedSfont) fluid_synth_remove_sfont(synth, sharedSfont);
+	delete_fluid_synth(synth);
+	delete_fluid_settings(settings);
+}
+
+
+void FluidSynthSink::configure(const SynthSettings& newSettings) {
+	lock_guard lock(setupMutex);
+	if (synth) {
+		cerr << "[FluidSynthSink] Synth already running, settings are ignored\n";
+		return;
+	}
+	synthSettings = newSettings;
+}
+
+void FluidSynthSink::applySettings(fluid_settings_t* settings, const SynthSettings& synthSettings) {
+	fluid_settings_setint(settings, "synth.midi-channels", MIDI_CHANNELS);  // Extended channel banks for themes
+	fluid_settings_setint(settings, "synth.cpu-cores", max(synthSettings.cpuCores, 1));
+	if (synthSettings.periodSize > 0) fluid_settings_setint(settings, "audio.period-size", synthSettings.periodSize);
+	if (synthSettings.periods > 0)	  fluid_settings_setint(settings, "audio.periods", synthSettings.periods);
+	if (synthSettings.polyphony > 0)  fluid_settings_setint(settings, "synth.polyphony", synthSettings.polyphony);
+	if (synthSettings.sampleRate > 0) fluid_settings_setnum(settings, "synth.sample-rate", synthSettings.sampleRate);
+	fluid_settings_setint(settings, "synth.dynamic-sample-loading", synthSettings.dynamicSampleLoading ? 1 : 0);
+}
+
+/** Create the synth and start audio with the settings configured so far (any thread, only the first call creates it) */
+void FluidSynthSink::ensureSynth() {
+	if (started.load(memory_order_acquire)) return;
+
+	lock_guard lock(setupMutex);
+	if (synth) return;  // Created by another thread in the meantime
+
+	settings = new_fluid_settings();
+	applySettings(settings, synthSettings);
+	synth	 = new_fluid_synth(settings);
+	fluid_settings_getnum(settings, "synth.sample-rate", &sampleRate);
+
+	// Custom audio callback, so that queued commands are applied on the audio thread
+	adriver = new_fluid_audio_driver2(settings, &FluidSynthSink::renderBlock, this);
+	if (!adriver)
+		cerr << "[FluidSynthSink] Failed to start audio, commands are applied directly\n";
+
+	started.store(true, memory_order_release);
+}
+
+
+/** Load a soundfont into this synth only (needed for dynamic sample loading, see SharedResources) */
+LoadedSoundfont FluidSynthSink::loadSoundfont(const string& path) {
+	ensureSynth();
+	const auto loadStart = Clock::now();
+
+	LoadedSoundfont loaded;
+	const int sfid = fluid_synth_sfload(synth, (RESOURCES_DIR + path).c_str(), 1);
+	if (sfid == FLUID_FAILED) {
+		cerr << "[FluidSynthSink] Failed to load soundfont: " << path << endl;
+	} else {
+		loaded.sfont = fluid_synth_get_sfont_by_id(synth, sfid);
+		publishSoundfont(loaded.sfont);
+	}
+
+	loaded.loadTime = Clock::now() - loadStart;
+	return loaded;
+}
+
+/** Use a soundfont that is owned (and already loaded) elsewhere */
+void FluidSynthSink::useSoundfont(fluid_sfont_t* soundfont) {
+	if (!soundfont) return;
+	ensureSynth();
+	fluid_synth_add_sfont(synth, soundfont);  // The returned id is only valid until the next synth adds it
+	sharedSfont = soundfont;
+	publishSoundfont(soundfont);
+}
+
+/** Make the soundfont's name visible to the audio thread and select the programs that were requested before it */
+void FluidSynthSink::publishSoundfont(fluid_sfont_t* soundfont) {
+	sfontName.store(fluid_sfont_get_name(soundfont), memory_order_release);
+
+	for (size_t channel = 0; channel < programs.size(); ++channel) {
+		if (const int program = programs[channel].load(memory_order_relaxed); program >= 0)
+			send(CommandType::PROGRAM, static_cast<unsigned char>(channel), static_cast<unsigned char>(program), 0);
+	}
+}
+
+
+void FluidSynthSink::noteOn(const unsigned char channel, const Note note, const unsigned char velocity) {
+	ensureSynth();
+	send(CommandType::NOTE_START, channel, note, velocity);
+}
+
+void FluidSynthSink::noteOff(const unsigned char channel, const Note note) {
+	if (!started.load(memory_order_acquire)) return;  // Nothing can be sounding
+	send(CommandType::NOTE_STOP, channel, note, 0);
+}
+
+void FluidSynthSink::programChange(const unsigned char channel, const int program) {
+	ensureSynth();
+	programs[channel].store(program, memory_order_relaxed);
+	send(CommandType::PROGRAM, channel, static_cast<unsigned char>(program), 0);
+}
+
+
+/** Queue a command for the audio thread (any thread, lock-free unless the queue overflowed) */
+void FluidSynthSink::send(
+	const CommandType type,
+	const unsigned char channel,
+	const unsigned char data1,
+	const unsigned char data2
+) {
+	const Command command{Clock::now(), type, channel, data1, data2};
+
+	if (!adriver) {
+		// No audio thread to drain the queue
+		directCommands.fetch_add(1, memory_order_relaxed);
+		apply(command);
+		return;
+	}
+
+	if (!overflowing.load(memory_order_acquire) && commands.push(command)) return;
+
+	// Queue full (or still overflowing): don't lose the command (a lost note-off would hang),
+	// and keep it behind everything queued before it
+	lock_guard lock(overflowMutex);
+	overflow.push_back(command);
+	overflowing.store(true, memory_order_release);
+	overflowCommands.fetch_add(1, memory_order_relaxed);
+}
+
+void FluidSynthSink::apply(const Command& command) const {
+	switch (command.type) {
+		case CommandType::NOTE_START:
+			fluid_synth_noteon(synth, command.channel, command.data1, command.data2);
+			break;
+		case CommandType::NOTE_STOP:
+			fluid_synth_noteoff(synth, command.channel, command.data1);
+			break;
+		case CommandType::PROGRAM:
+			// Without a soundfont yet, publishSoundfont() sends the program again
+			if (const char* name = sfontName.load(memory_order_acquire))
+				fluid_synth_program_select_by_sfont_name(synth, command.channel, name, 0, command.data1);  // channel, soundfont, bank, preset
+			break;
+	}
+}
+
+
+int FluidSynthSink::renderBlock(void* data, const int len, const int nfx, float* fx[], const int nout, float* out[]) {
+	return static_cast<FluidSynthSink*>(data)->render(len, nfx, fx, nout, out);
+}
+
+/**
+ * Audio thread: render one block, applying the queued commands in between.
+ * Commands sent during the previous block are spread over this block at the same relative positions.
+ */
+int FluidSynthSink::render(const int len, const int nfx, float* fx[], const int nout, float* out[]) {
+	const auto blockTime = Clock::now();
+	const auto previousBlockTime = lastBlockTime == Clock::time_point{} ? blockTime : lastBlockTime;
+	lastBlockTime = blockTime;
+
+	const double framesPerMicro = sampleRate / 1e6;
+	const bool canSplit = nfx <= MAX_AUDIO_BUFFERS && nout <= MAX_AUDIO_BUFFERS;
+
+	float* fxPart[MAX_AUDIO_BUFFERS];
+	float* outPart[MAX_AUDIO_BUFFERS];
+	auto renderUpTo = [&](const int from, const int to) {
+		if (to <= from) return FLUID_OK;
+		for (int i = 0; i < nfx; ++i)  fxPart[i]  = fx[i] ? fx[i] + from : nullptr;
+		for (int i = 0; i < nout; ++i) outPart[i] = out[i] + from;
+		return fluid_synth_process(synth, to - from, nfx, fxPart, nout, outPart);
+	};
+
+	int rendered = 0;
+	while (const auto command = commands.pop()) {
+		if (canSplit) {
+			const auto sinceBlockStart = chrono::duration<double, micro>(command->time - previousBlockTime).count();
+			const int offset = clamp(static_cast<int>(sinceBlockStart * framesPerMicro), rendered, len);
+			if (renderUpTo(rendered, offset) != FLUID_OK) return FLUID_FAILED;
+			rendered = offset;
+		}
+		apply(*command);
+	}
+
+	// Overflowed commands come after everything in the queue. If a producer holds the lock, they wait for the next block
+	if (overflowing.load(memory_order_acquire)) {
+		if (unique_lock lock(overflowMutex, try_to_lock); lock) {
+			while (const auto command = commands.pop()) apply(*command);  // Pushed right before the overflow started
+			for (const Command& command : overflow) apply(command);
+			overflow.clear();
+			overflowing.store(false, memory_order_release);
+		}
+	}
+
+	if (!canSplit) return fluid_synth_process(synth, len, nfx, fx, nout, out);
+	return renderUpTo(rendered, len);
+}
+
+
+SynthLoad FluidSynthSink::getLoad() const {
+	if (!started.load(memory_order_acquire)) return {};
+	return {
+		fluid_synth_get_cpu_load(synth),
+		fluid_synth_get_active_voice_count(synth),
+		fluid_synth_get_polyphony(synth)
+	};
+}
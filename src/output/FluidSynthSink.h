@@ -0,0 +1,101 @@
+#pragma once
+
+#include "OutputSink.h"
+#include "util/MPSCQueue.h"
+#include "util/Timing.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * Plays the output live on a FluidSynth synth with its own audio driver.
+ * The synth is only created on first use (from whichever thread comes first), so it can still be configured
+ * (e.g. from Lua) after construction.
+ *
+ * Notes and program changes don't call into the synth (and its mutex) directly: they are timestamped and queued
+ * in a lock-free ring, which the audio callback drains right before rendering each block. A command is applied at
+ * the position within the block that corresponds to when it was sent during the previous block, so timing stays
+ * sample-accurate at a constant latency of one block instead of jittering with the block boundaries.
+ * If the ring is full, commands go to a locked overflow list instead, which the audio thread applies after the ring.
+ * Until it has done so, all further commands go there too, so they are never reordered (e.g. a note-off before its note-on).
+ */
+class FluidSynthSink final : public OutputSink {
+public:
+	explicit FluidSynthSink(const SynthSettings& synthSettings = {});
+	~FluidSynthSink() override;
+
+	FluidSynthSink(const FluidSynthSink&) = delete;
+	FluidSynthSink& operator=(const FluidSynthSink&) = delete;
+
+	LoadedSoundfont loadSoundfont(const std::string& path) override;
+	void useSoundfont(fluid_sfont_t* soundfont) override;
+	void configure(const SynthSettings& synthSettings) override;
+
+	/** Write the settings into FluidSynth settings (also used by the synth benchmark) */
+	static void applySettings(fluid_settings_t* settings, const SynthSettings& synthSettings);
+
+	void noteOn(unsigned char channel, Note note, unsigned char velocity) override;
+	void noteOff(unsigned char channel, Note note) override;
+	void programChange(unsigned char channel, int program) override;
+
+	[[nodiscard]] SynthLoad getLoad() const override;
+
+	[[nodiscard]] uint64_t directCommandCount() const { return directCommands.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t overflowCommandCount() const { return overflowCommands.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t COMMAND_QUEUE_CAPACITY = 4096;
+	static constexpr int MAX_AUDIO_BUFFERS		   = 32;  // Render buffers the block can be split for
+
+	enum class CommandType : unsigned char { NOTE_START, NOTE_STOP, PROGRAM };  // NOTE_ON/NOTE_OFF are taken by Util.h
+
+	struct Command {
+		Clock::time_point time;
+		CommandType type;
+		unsigned char channel;
+		unsigned char data1;  // Note or program
+		unsigned char data2;  // Velocity
+	};
+
+	SynthSettings synthSettings;
+	double sampleRate = 44100.0;
+
+	MPSCQueue<Command, COMMAND_QUEUE_CAPACITY> commands;
+	std::atomic<uint64_t> directCommands{0};	// Applied directly because there is no audio thread
+	std::atomic<uint64_t> overflowCommands{0};	// Sent while the queue was full
+
+	// Commands that didn't fit into the queue, in order (only try-locked by the audio thread)
+	std::mutex overflowMutex;
+	std::vector<Command> overflow;
+	std::atomic<bool> overflowing{false};  // Set while `overflow` has commands the audio thread hasn't applied yet
+
+	// Audio thread only
+	Clock::time_point lastBlockTime;
+
+	std::mutex setupMutex;				// Guards creating the synth against configure() and concurrent first uses
+	std::atomic<bool> started{false};	// Set once the synth (and audio) exists
+	fluid_settings_t* settings	  = nullptr;
+	fluid_synth_t* synth		  = nullptr;
+	fluid_audio_driver_t *adriver = nullptr;
+
+	// FluidSynth overwrites a soundfont's id whenever it is added to a synth, so a shared soundfont has no id
+	// this synth could rely on: presets are selected by the soundfont's name instead.
+	// The name is owned by the soundfont and published once it was added; the audio thread reads it for PROGRAM commands
+	std::atomic<const char*> sfontName{nullptr};
+	fluid_sfont_t* sharedSfont = nullptr;  // Borrowed from SharedResources, must be removed before deleting the synth
+
+	// Last program per channel (-1 = none), re-sent once the soundfont is published: earlier ones had nothing to select
+	std::array<std::atomic<int>, MIDI_CHANNELS> programs;
+
+	void ensureSynth();
+	void publishSoundfont(fluid_sfont_t* soundfont);
+	void send(CommandType type, unsigned char channel, unsigned char data1, unsigned char data2);
+	void apply(const Command& command) const;
+
+	static int renderBlock(void* data, int len, int nfx, float* fx[], int nout, float* out[]);
+	int render(int len, int nfx, float* fx[], int nout, float* out[]);
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "OutputSink.h"
+
+#include <atomic>
+#include <cstdint>
+
+
+/** Discards all output and only counts it (from any thread), for measuring generation without synthesis cost */
+class NullSink final : public OutputSink {
+public:
+	void noteOn(unsigned char, Note, unsigned char) override { ++noteOns; }
+	void noteOff(unsigned char, Note) override { ++noteOffs; }
+	void programChange(unsigned char, int) override { ++programChanges; }
+
+	std::atomic<uint64_t> noteOns{0};
+	std::atomic<uint64_t> noteOffs{0};
+	std::atomic<uint64_t> programChanges{0};
+};
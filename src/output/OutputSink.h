@@ -0,0 +1,59 @@
+#pragma once
+
+#include <fluidsynth.h>
+
+#include "util/Timing.h"
+#include "util/Util.h"
+
+#include <string>
+
+
+/** Render and audio settings of a synthesizing sink (0 = FluidSynth's default) */
+struct SynthSettings {
+	int cpuCores	  = 1;		// synth.cpu-cores, render threads
+	int periodSize	  = 0;		// audio.period-size, frames per audio buffer
+	int periods		  = 0;		// audio.periods, buffers in flight (latency = periods * periodSize / sampleRate)
+	int polyphony	  = 0;		// synth.polyphony, voice limit
+	double sampleRate = 0.0;	// synth.sample-rate
+	bool dynamicSampleLoading = false;	// synth.dynamic-sample-loading, only load the samples of selected presets.
+										// The soundfont then can't be shared, the sink loads its own (loadSoundfont())
+};
+
+/** A loaded soundfont, and how long loading it took */
+struct LoadedSoundfont {
+	fluid_sfont_t* sfont = nullptr;  // nullptr if loading failed
+	Clock::duration loadTime{};
+};
+
+/** How busy a synthesizing sink is (all zero for sinks that don't synthesize) */
+struct SynthLoad {
+	double cpuLoad	 = 0.0;  // In percent of the audio period
+	int activeVoices = 0;
+	int polyphony	 = 0;	 // Voice limit
+};
+
+
+/**
+ * Destination of the MIDI messages a session plays (a synth, a file, nothing at all).
+ * Only called with valid notes (0..127) and balanced note-on/off pairs, MIDI filters the rest.
+ * Channels may exceed 15, see `MIDI_CHANNELS`.
+ */
+class OutputSink {
+public:
+	virtual ~OutputSink() = default;
+
+	virtual void noteOn(unsigned char channel, Note note, unsigned char velocity) = 0;
+	virtual void noteOff(unsigned char channel, Note note) = 0;
+	virtual void programChange(unsigned char channel, int program) = 0;
+
+	/** Soundfont owned elsewhere (see SharedResources), ignored by sinks that don't synthesize */
+	virtual void useSoundfont(fluid_sfont_t* /*soundfont*/) {}
+
+	/** Load a soundfont (path relative to the resources directory) only for this sink, may run on any thread */
+	virtual LoadedSoundfont loadSoundfont(const std::string& /*path*/) { return {}; }
+
+	/** Only takes effect before the first message, ignored by sinks that don't synthesize */
+	virtual void configure(const SynthSettings& /*settings*/) {}
+
+	[[nodiscard]] virtual SynthLoad getLoad() const { return {}; }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "OutputSink.h"
+
+#include <algorithm>
+
+
+/**
+ * Sheds low-priority layers before the synth runs out of voices or CPU time (audio underruns).
+ * Checked once per measure: while the load is above the high thresholds the shed level rises by one per measure,
+ * and only after several calm measures below the low thresholds it drops again, so layers don't flicker.
+ * Level 1 drops the upper chord layers, level 2 also the extra lead octaves.
+ */
+class PolyphonyGovernor {
+public:
+	static constexpr int MAX_LEVEL = 2;
+
+	static constexpr double HIGH_CPU_LOAD	 = 70.0;  // Percent
+	static constexpr double LOW_CPU_LOAD	 = 50.0;
+	static constexpr double HIGH_VOICE_RATIO = 0.75;  // Of the polyphony limit
+	static constexpr double LOW_VOICE_RATIO	 = 0.50;
+	static constexpr int RECOVERY_MEASURES	 = 4;
+
+	/** Feed the current load, returns the shed level to use for the next measure */
+	int update(const SynthLoad& load) {
+		const double voiceRatio = load.polyphony > 0
+			? static_cast<double>(load.activeVoices) / load.polyphony
+			: 0.0;
+
+		if (load.cpuLoad > HIGH_CPU_LOAD || voiceRatio > HIGH_VOICE_RATIO) {
+			level = std::min(level + 1, MAX_LEVEL);
+			calmMeasures = 0;
+		} else if (load.cpuLoad < LOW_CPU_LOAD && voiceRatio < LOW_VOICE_RATIO) {
+			if (level > 0 && ++calmMeasures >= RECOVERY_MEASURES) {
+				--level;
+				calmMeasures = 0;
+			}
+		} else {
+			calmMeasures = 0;
+		}
+		return level;
+	}
+
+	/** Cap the layers for the current level */
+	void apply(int& leadLayers, int& chordLayers) const {
+		if (level >= 1) chordLayers = std::min(chordLayers, 1);
+		if (level >= 2) leadLayers	= std::min(leadLayers, 1);
+	}
+
+	[[nodiscard]] int getLevel() const { return level; }
+
+private:
+	int level = 0;
+	int calmMeasures = 0;
+};
@@ -0,0 +1,206 @@
+#include "RecordingSink.h"
+
+#include <MidiFile.h>
+
+#include "util/TimingStats.h"
+
+using namespace std;
+using namespace smf;
+
+
+RecordingSink::RecordingSink(unique_ptr<OutputSink> inner, string path)
+	: inner(move(inner)), path(move(path)) {
+	out.open(this->path, ios::binary | ios::trunc);
+	if (!out) {
+		cerr << "[RecordingSink] Failed to open " << this->path << endl;
+		return;
+	}
+	writer = thread([this] { writerLoop(); });
+}
+
+RecordingSink::~RecordingSink() {
+	stopping.store(true);
+	wakeWriter();
+	if (writer.joinable()) writer.join();
+
+	if (const uint64_t lost = droppedCount(); lost > 0)
+		cerr << "[RecordingSink] " << lost << " messages were dropped while recording\n";
+	if (const uint64_t waits = stalledCount(); waits > 0)
+		cerr << "[RecordingSink] " << waits << " note-offs had to wait for the writer\n";
+}
+
+
+void RecordingSink::noteOn(const unsigned char channel, const Note note, const unsigned char velocity) {
+	inner->noteOn(channel, note, velocity);
+	record(MessageType::NOTE_START, channel, note, velocity);
+}
+
+void RecordingSink::noteOff(const unsigned char channel, const Note note) {
+	inner->noteOff(channel, note);
+	record(MessageType::NOTE_STOP, channel, note, 0);
+}
+
+void RecordingSink::programChange(const unsigned char channel, const int program) {
+	inner->programChange(channel, program);
+	record(MessageType::PROGRAM, channel, static_cast<unsigned char>(program), 0);
+}
+
+/** Called on the playing threads: no locks, no allocations, and only a full queue makes a note-off wait */
+void RecordingSink::record(
+	const MessageType type,
+	const unsigned char channel,
+	const unsigned char data1,
+	const unsigned char data2
+) {
+	if (!writer.joinable()) return;
+
+	const Message message{microsBetween(startTime, Clock::now()), type, channel, data1, data2};
+	if (!queue.push(message)) {
+		if (type != MessageType::NOTE_STOP) {
+			dropped.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+
+		stalled.fetch_add(1, memory_order_relaxed);
+		do {
+			wakeWriter();
+			this_thread::yield();
+		} while (!queue.push(message));
+	}
+	wakeWriter();
+}
+
+/** Wake the writer if it went idle (cheap otherwise: one fence and one load) */
+void RecordingSink::wakeWriter() {
+	atomic_thread_fence(memory_order_seq_cst);  // Orders the push before reading the flag (see waitForMessages())
+	if (writerIdle.load(memory_order_relaxed) && writerIdle.exchange(false))
+		writerWake.release();
+}
+
+
+void RecordingSink::writerLoop() {
+	writeHeader();
+
+	auto nextFlush = Clock::now() + FLUSH_INTERVAL;
+	bool unflushed = false;
+	while (true) {
+		const bool finalPass = stopping.load();
+
+		bool wroteAny = false;
+		while (const auto message = queue.pop()) {
+			writeMessage(*message);
+			wroteAny = true;
+		}
+		unflushed |= wroteAny;
+
+		if (finalPass) break;
+
+		// The file is readable up to here even if the process dies
+		if (unflushed && (!wroteAny || Clock::now() >= nextFlush)) {
+			out.flush();
+			unflushed = false;
+			nextFlush = Clock::now() + FLUSH_INTERVAL;
+		}
+		if (!wroteAny) waitForMessages();
+	}
+
+	finishFile();
+}
+
+/** Sleep until a producer pushed something (or the sink is stopping) */
+void RecordingSink::waitForMessages() {
+	writerIdle.store(true);
+	atomic_thread_fence(memory_order_seq_cst);  // Pairs with wakeWriter(): either we see the push, or it sees the flag
+
+	if (queue.empty() && !stopping.load()) {
+		writerWake.acquire();
+	} else if (!writerIdle.exchange(false)) {
+		writerWake.acquire();  // A producer cleared the flag in the meantime and released the semaphore
+	}
+}
+
+
+static void writeBigEndian(ostream& out, const uint32_t value, const int bytes) {
+	for (int i = bytes - 1; i >= 0; --i)
+		out.put(static_cast<char>(value >> (8 * i) & 0xFF));
+}
+
+/** Header and the start of the only track, its length is filled in by finishFile() */
+void RecordingSink::writeHeader() {
+	out.write("MThd", 4);
+	writeBigEndian(out, 6, 4);
+	writeBigEndian(out, 0, 2);  // Format 0
+	writeBigEndian(out, 1, 2);  // One track
+	writeBigEndian(out, static_cast<uint32_t>(PPQ), 2);
+
+	out.write("MTrk", 4);
+	writeBigEndian(out, 0, 4);  // Track length placeholder
+
+	MidiMessage tempo;
+	tempo.makeTempo(TEMPO_BPM);
+	writeEvent(0, tempo.data(), tempo.size());
+}
+
+void RecordingSink::writeMessage(const Message& message) {
+	const int64_t tick = message.micros * PPQ * TEMPO_BPM / 60'000'000;
+	const int channel  = message.channel % 16;
+
+	// Switch the port when the channel is in another bank of 16
+	if (const int port = message.channel / 16; port != currentPort) {
+		const unsigned char portPrefix[] = {0xFF, 0x21, 0x01, static_cast<unsigned char>(port)};
+		writeEvent(tick, portPrefix, sizeof(portPrefix));
+		currentPort = port;
+	}
+
+	MidiMessage midiMessage;
+	switch (message.type) {
+		case MessageType::NOTE_START:
+			midiMessage.makeNoteOn(channel, message.data1, message.data2);
+			sounding.add(message.channel, message.data1);
+			break;
+		case MessageType::NOTE_STOP:
+			midiMessage.makeNoteOff(channel, message.data1);
+			sounding.remove(message.channel, message.data1);
+			break;
+		case MessageType::PROGRAM:
+			midiMessage.makePatchChange(channel, message.data1);
+			break;
+	}
+	writeEvent(tick, midiMessage.data(), midiMessage.size());
+}
+
+/** Delta time (variable-length quantity) followed by the event bytes */
+void RecordingSink::writeEvent(const int64_t tick, const unsigned char* bytes, const size_t size) {
+	auto delta = static_cast<uint32_t>(max<int64_t>(tick - lastTick, 0));
+	lastTick = max(lastTick, tick);
+
+	unsigned char vlq[5];
+	int length = 0;
+	vlq[length++] = delta & 0x7F;
+	while (delta >>= 7)
+		vlq[length++] = (delta & 0x7F) | 0x80;
+	for (int i = length - 1; i >= 0; --i)
+		out.put(static_cast<char>(vlq[i]));
+
+	out.write(reinterpret_cast<const char*>(bytes), static_cast<streamsize>(size));
+	trackBytes += length + static_cast<uint32_t>(size);
+}
+
+void RecordingSink::finishFile() {
+	// Close what is still sounding (e.g. its note-off came after the recording ended)
+	const int64_t endMicros = microsBetween(startTime, Clock::now());
+	for (int channel = 0; channel < MIDI_CHANNELS; ++channel) {
+		sounding.releaseAll(static_cast<unsigned char>(channel), [&](const Note note) {
+			writeMessage({endMicros, MessageType::NOTE_STOP, static_cast<unsigned char>(channel), note, 0});
+		});
+	}
+
+	constexpr unsigned char endOfTrack[] = {0xFF, 0x2F, 0x00};
+	writeEvent(lastTick, endOfTrack, sizeof(endOfTrack));
+
+	out.seekp(18);  // Track length, right after "MTrk"
+	writeBigEndian(out, trackBytes, 4);
+	out.close();
+
+	cout << "[RecordingSink] Recorded " << path << endl;
+}
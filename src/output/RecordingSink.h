@@ -0,0 +1,89 @@
+#pragma once
+
+#include "OutputSink.h"
+#include "data/ActiveVoices.h"
+#include "util/MPSCQueue.h"
+#include "util/Timing.h"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <semaphore>
+#include <thread>
+
+
+/**
+ * Forwards everything to another sink and records it into a Standard MIDI File on the side.
+ * The playing threads only timestamp each message and push it to a lock-free queue. A background writer, woken
+ * whenever it ran idle, encodes the messages and appends them to the file as they come, flushing regularly,
+ * so long sessions aren't held in memory. If the writer falls behind, note-ons and program changes are dropped,
+ * but note-offs wait for room (a lost one would hang its note until the end of the file).
+ * Notes still sounding when the recording ends are closed in the file.
+ * The file is one format 0 track. Channels beyond 16 are told apart by MIDI port prefix meta events.
+ */
+class RecordingSink final : public OutputSink {
+public:
+	RecordingSink(std::unique_ptr<OutputSink> inner, std::string path);
+	~RecordingSink() override;
+
+	RecordingSink(const RecordingSink&) = delete;
+	RecordingSink& operator=(const RecordingSink&) = delete;
+
+	void noteOn(unsigned char channel, Note note, unsigned char velocity) override;
+	void noteOff(unsigned char channel, Note note) override;
+	void programChange(unsigned char channel, int program) override;
+	void useSoundfont(fluid_sfont_t* soundfont) override { inner->useSoundfont(soundfont); }
+	LoadedSoundfont loadSoundfont(const std::string& path) override { return inner->loadSoundfont(path); }
+	void configure(const SynthSettings& settings) override { inner->configure(settings); }
+	[[nodiscard]] SynthLoad getLoad() const override { return inner->getLoad(); }
+
+	[[nodiscard]] uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t stalledCount() const { return stalled.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t QUEUE_CAPACITY	= 8192;
+	static constexpr int TEMPO_BPM			= 120;  // Fixed file tempo, wall time maps to ticks 1:1 through it
+	static constexpr auto FLUSH_INTERVAL	= std::chrono::seconds(1);
+
+	enum class MessageType : unsigned char { NOTE_START, NOTE_STOP, PROGRAM };  // NOTE_ON/NOTE_OFF are taken by Util.h
+
+	struct Message {
+		int64_t micros;  // Since the recording started
+		MessageType type;
+		unsigned char channel;
+		unsigned char data1;  // Note or program
+		unsigned char data2;  // Velocity
+	};
+
+	std::unique_ptr<OutputSink> inner;
+	std::string path;
+	Clock::time_point startTime = Clock::now();
+
+	MPSCQueue<Message, QUEUE_CAPACITY> queue;
+	std::atomic<uint64_t> dropped{0};  // Messages lost because the writer fell behind
+	std::atomic<uint64_t> stalled{0};  // Note-offs that had to wait for the writer
+
+	// Wakes the writer: set by the writer before it sleeps, whoever clears it releases the semaphore
+	std::atomic<bool> writerIdle{false};
+	std::binary_semaphore writerWake{0};
+
+	// Writer thread only
+	std::ofstream out;
+	int64_t lastTick  = 0;
+	uint32_t trackBytes = 0;
+	int currentPort = 0;
+	ActiveVoices sounding;  // Notes on in the file so far
+
+	std::atomic<bool> stopping{false};
+	std::thread writer;
+
+	void record(MessageType type, unsigned char channel, unsigned char data1, unsigned char data2);
+
+	void wakeWriter();
+	void writerLoop();
+	void waitForMessages();
+	void writeHeader();
+	void writeMessage(const Message& message);
+	void writeEvent(int64_t tick, const unsigned char* bytes, size_t size);
+	void finishFile();
+};
@@ -0,0 +1,53 @@
+#include "SMFSink.h"
+
+#include "util/TimingStats.h"
+
+using namespace std;
+
+
+SMFSink::SMFSink(string path) : path(move(path)) {
+	file.absoluteTicks();
+	file.setTicksPerQuarterNote(static_cast<int>(PPQ));
+	file.addTrack((MIDI_CHANNELS + 15) / 16 - 1);  // One track per channel bank
+	file.addTempo(0, 0, TEMPO_BPM);
+}
+
+SMFSink::~SMFSink() {
+	if (!saved) save();  // No more messages can arrive here
+}
+
+
+/** Ticks since the sink was created */
+int SMFSink::now() const {
+	const int64_t micros = microsBetween(startTime, Clock::now());
+	return static_cast<int>(micros * PPQ * TEMPO_BPM / 60'000'000);
+}
+
+void SMFSink::noteOn(const unsigned char channel, const Note note, const unsigned char velocity) {
+	lock_guard lock(fileMutex);
+	file.addNoteOn(track(channel), now(), channel % 16, note, velocity);
+}
+
+void SMFSink::noteOff(const unsigned char channel, const Note note) {
+	lock_guard lock(fileMutex);
+	file.addNoteOff(track(channel), now(), channel % 16, note);
+}
+
+void SMFSink::programChange(const unsigned char channel, const int program) {
+	lock_guard lock(fileMutex);
+	file.addPatchChange(track(channel), now(), channel % 16, program);
+}
+
+
+bool SMFSink::save() {
+	lock_guard lock(fileMutex);
+	saved = true;
+
+	file.sortTracks();
+	if (!file.write(path)) {
+		cerr << "[SMFSink] Failed to write " << path << endl;
+		return false;
+	}
+	cout << "[SMFSink] Wrote " << path << endl;
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <MidiFile.h>
+
+#include <mutex>
+
+#include "OutputSink.h"
+#include "util/Timing.h"
+
+
+/**
+ * Captures the output into a Standard MIDI File, timestamped with the wall time of each message.
+ * Channels beyond 16 can't be expressed in one SMF track, so every bank of 16 channels gets its own track.
+ * The file is written when the sink is destroyed (or on save()).
+ * Thread-safe: the playback, game state and Lua threads all send messages.
+ */
+class SMFSink final : public OutputSink {
+public:
+	explicit SMFSink(std::string path);
+	~SMFSink() override;
+
+	SMFSink(const SMFSink&) = delete;
+	SMFSink& operator=(const SMFSink&) = delete;
+
+	void noteOn(unsigned char channel, Note note, unsigned char velocity) override;
+	void noteOff(unsigned char channel, Note note) override;
+	void programChange(unsigned char channel, int program) override;
+
+	bool save();
+
+private:
+	static constexpr int TEMPO_BPM = 120;  // Fixed file tempo, wall time maps to ticks 1:1 through it
+
+	std::string path;
+	std::mutex fileMutex;  // Guards file and saved
+	smf::MidiFile file;
+	Clock::time_point startTime = Clock::now();
+	bool saved = false;
+
+	[[nodiscard]] int now() const;
+	static int track(const unsigned char channel) { return channel / 16; }
+};
@@ -50,8 +50,8 @@ inline void printScheduledEvent(const std::shared_ptr<ScheduledEvent> &event) {
 		return;
 
 	cout << format(
-		"{:<26}", format("Playing {:<6} for {:>4} ms",
-		getNoteName(event->note), static_cast<int>(round(event->duration))))
+		"{:<26}", format("Playing {:<6} for {:>4} ticks",
+		getNoteName(event->note), event->duration))
 	<< endl;
 }
 
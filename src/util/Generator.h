@@ -0,0 +1,97 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+
+/**
+ * Lazily evaluated sequence produced by a coroutine (`co_yield`), usable as an input range,
+ * so it composes with `std::views` (e.g. `events | views::transform(...)`).
+ * Unlike `std::generator`, begin() may be called again: it continues where the previous loop left off.
+ * An element is consumed by incrementing past it, so one infinite generator can be read in batches.
+ */
+template<typename T>
+class Generator {
+public:
+	struct promise_type {
+		const T* current = nullptr;
+		std::exception_ptr exception;
+
+		Generator get_return_object() {
+			return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+
+		std::suspend_always yield_value(const T& value) noexcept {
+			current = std::addressof(value);
+			return {};
+		}
+
+		void return_void() noexcept {}
+		void unhandled_exception() { exception = std::current_exception(); }
+
+		void await_transform() = delete;  // Generators don't await
+	};
+
+	class iterator {
+	public:
+		using value_type	  = T;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() = default;
+		explicit iterator(const std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+		const T& operator*() const { return *handle.promise().current; }
+		const T* operator->() const { return handle.promise().current; }
+
+		iterator& operator++() {
+			advance(handle);
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+
+		bool operator==(std::default_sentinel_t) const { return !handle || handle.done(); }
+
+	private:
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	Generator() = default;
+	Generator(Generator&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+	Generator& operator=(Generator&& other) noexcept {
+		if (this != &other) {
+			if (handle) handle.destroy();
+			handle = std::exchange(other.handle, {});
+		}
+		return *this;
+	}
+	~Generator() { if (handle) handle.destroy(); }
+
+	Generator(const Generator&) = delete;
+	Generator& operator=(const Generator&) = delete;
+
+	iterator begin() {
+		if (handle && !handle.done() && !handle.promise().current)
+			advance(handle);  // Run up to the first co_yield
+		return iterator(handle);
+	}
+	static std::default_sentinel_t end() { return std::default_sentinel; }
+
+	explicit operator bool() const { return handle && !handle.done(); }
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	explicit Generator(const std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	static void advance(const std::coroutine_handle<promise_type> handle) {
+		handle.resume();
+		if (handle.promise().exception)
+			std::rethrow_exception(std::exchange(handle.promise().exception, {}));
+	}
+};
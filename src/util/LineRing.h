@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+
+/**
+ * Fixed-capacity byte ring for newline framing of a stream. recv() writes straight into writable(),
+ * and drainLines() hands out every complete line as a `string_view`, without copying or moving the rest.
+ * Only a line that wraps around the end of the ring is copied, into a scratch buffer of the same capacity.
+ * Both buffers are allocated once; the views stay valid until the next call.
+ * A stream can switch to length-prefixed binary frames midway (see drainFrames()).
+ */
+template<size_t Capacity>
+class LineRing {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	LineRing() : data(std::make_unique<char[]>(Capacity)), scratch(std::make_unique<char[]>(Capacity)) {}
+
+	/** Contiguous free space at the write position (empty when the ring is full) */
+	std::span<char> writable() {
+		const size_t start = tail & MASK;
+		return {data.get() + start, std::min(Capacity - (tail - head), Capacity - start)};
+	}
+
+	/** Mark `count` bytes written into writable() as received */
+	void commit(const size_t count) { tail += count; }
+
+	/**
+	 * Call `onLine(string_view)` for every complete line (without the '\n') and return how many there were.
+	 * If `onLine` returns a bool, false stops after that line (e.g. because the stream switches to frames).
+	 */
+	template<typename F>
+	size_t drainLines(F&& onLine) {
+		size_t lines = 0;
+		while (scanned < tail) {
+			// Search the contiguous part of the unscanned bytes
+			const size_t start = scanned & MASK;
+			const size_t length = std::min(tail - scanned, Capacity - start);
+			const auto* nl = static_cast<const char*>(std::memchr(data.get() + start, '\n', length));
+			if (!nl) {
+				scanned += length;
+				continue;
+			}
+
+			const size_t end = scanned + (nl - (data.get() + start));
+			const std::string_view line = view(head, end);
+			head = scanned = end + 1;
+			++lines;
+
+			if constexpr (std::is_same_v<std::invoke_result_t<F&, std::string_view>, bool>) {
+				if (!onLine(line)) break;
+			} else {
+				onLine(line);
+			}
+		}
+		return lines;
+	}
+
+	/**
+	 * Call `onFrame(string_view)` for every complete frame, each preceded by its length as a host order u32.
+	 * Returns false if a frame is announced that could never fit into the ring (the stream cannot be framed).
+	 */
+	template<typename F>
+	bool drainFrames(F&& onFrame) {
+		while (tail - head >= sizeof(uint32_t)) {
+			uint32_t length;
+			std::memcpy(&length, view(head, head + sizeof(uint32_t)).data(), sizeof(uint32_t));
+			if (length > Capacity - sizeof(uint32_t)) return false;
+			if (tail - head < sizeof(uint32_t) + length) break;  // Incomplete
+
+			const size_t start = head + sizeof(uint32_t);
+			head = scanned = start + length;
+			onFrame(view(start, start + length));
+		}
+		scanned = head;
+		return true;
+	}
+
+	[[nodiscard]] bool full() const { return tail - head == Capacity; }
+	[[nodiscard]] size_t size() const { return tail - head; }
+	void clear() { head = scanned = tail; }
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	static constexpr size_t MASK = Capacity - 1;
+
+	std::unique_ptr<char[]> data;
+	std::unique_ptr<char[]> scratch;  // Wrapped lines are made contiguous here
+
+	// Monotonic positions (masked on access): head <= scanned <= tail
+	size_t head = 0;	 // Start of the current (incomplete) line
+	size_t scanned = 0;	 // Everything before this has no '\n'
+	size_t tail = 0;	 // End of the received bytes
+
+	std::string_view view(const size_t from, const size_t to) const {
+		const size_t start = from & MASK;
+		const size_t length = to - from;
+		if (start + length <= Capacity) return {data.get() + start, length};
+
+		const size_t first = Capacity - start;
+		std::memcpy(scratch.get(), data.get() + start, first);
+		std::memcpy(scratch.get() + first, data.get(), length - first);
+		return {scratch.get(), length};
+	}
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+
+/**
+ * Bounded lock-free FIFO from any number of producer threads to one consumer thread.
+ * Every slot carries a sequence number that tells whose turn it is, so producers only race for the tail index
+ * (one CAS) and never wait for each other. Neither side ever blocks or allocates:
+ * push() fails when the queue is full and pop() returns nothing when it is empty.
+ */
+template<typename T, size_t Capacity>
+class MPSCQueue {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	MPSCQueue() {
+		for (size_t i = 0; i < Capacity; ++i)
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	/** Any producer: false if the queue is full (the value is dropped) */
+	bool push(const T& value) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &slots[pos & MASK];
+			const size_t seq  = slot->sequence.load(std::memory_order_acquire);
+			const auto diff   = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (diff < 0) {
+				return false;  // Full: the consumer hasn't freed this slot yet
+			} else {
+				pos = tail.load(std::memory_order_relaxed);  // Another producer took it
+			}
+		}
+		slot->value = value;
+		slot->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Consumer: oldest value, if any */
+	std::optional<T> pop() {
+		Slot& slot = slots[head & MASK];
+		if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+			return std::nullopt;
+
+		T value = slot.value;
+		slot.sequence.store(head + Capacity, std::memory_order_release);
+		++head;
+		return value;
+	}
+
+	/** Consumer: nothing to pop right now */
+	[[nodiscard]] bool empty() const {
+		return slots[head & MASK].sequence.load(std::memory_order_acquire) != head + 1;
+	}
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	static constexpr size_t MASK = Capacity - 1;
+
+	struct Slot {
+		std::atomic<size_t> sequence;
+		T value{};
+	};
+
+	std::array<Slot, Capacity> slots;
+	alignas(64) std::atomic<size_t> tail{0};	// Shared by the producers
+	alignas(64) size_t head = 0;				// Owned by the consumer
+};
@@ -0,0 +1,122 @@
+#include "RealTime.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+	#include <malloc.h>
+#else
+	#include <alloca.h>
+	#include <pthread.h>
+	#include <sched.h>
+	#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+
+constexpr int REALTIME_PRIORITY			= 10;			// Above SCHED_FIFO's minimum, below audio/IRQ threads
+constexpr size_t PREFAULT_STACK_BYTES	= 256 * 1024;
+
+
+void enterRealTimeMode() {
+	const bool raised = raiseThreadPriority();
+	const bool locked = prefaultStack(PREFAULT_STACK_BYTES);
+
+	cout << "[RealTime] Stack locked: " << (locked ? "yes" : "no")
+		 << ", real-time priority: " << (raised ? "yes" : "no") << endl;
+}
+
+
+bool raiseThreadPriority() {
+	#ifdef _WIN32
+		return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+	#else
+		sched_param param{};
+		param.sched_priority = sched_get_priority_min(SCHED_FIFO) + REALTIME_PRIORITY;
+		return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+	#endif
+}
+
+bool lockMemory(const void* data, const size_t bytes) {
+	if (!data || bytes == 0) return true;
+	#ifdef _WIN32
+		return VirtualLock(const_cast<void*>(data), bytes) != 0;
+	#else
+		return mlock(data, bytes) == 0;
+	#endif
+}
+
+void unlockMemory(const void* data, const size_t bytes) {
+	if (!data || bytes == 0) return;
+	#ifdef _WIN32
+		VirtualUnlock(const_cast<void*>(data), bytes);
+	#else
+		munlock(data, bytes);
+	#endif
+}
+
+/** Touch and lock every page of the next `bytes` of stack, so that deep calls later don't page-fault */
+bool prefaultStack(const size_t bytes) {
+	const auto buffer = static_cast<volatile char*>(alloca(bytes));
+	for (size_t i = 0; i < bytes; i += 4096)
+		buffer[i] = 0;
+	return lockMemory(const_cast<char*>(buffer), bytes);  // Stays locked after returning: the pages belong to the thread's stack
+}
+
+
+// Allocation counting (replaces the global operator new/delete)
+namespace {
+	thread_local uint64_t allocations = 0;
+}
+
+uint64_t threadAllocationCount() {
+	return allocations;
+}
+
+void* operator new(const size_t size) {
+	++allocations;
+	if (void* p = malloc(size ? size : 1)) return p;
+	throw bad_alloc();
+}
+
+void* operator new[](const size_t size) {
+	return ::operator new(size);
+}
+
+// Over-aligned types (alignas beyond max_align_t) bypass the plain overloads, so they are counted too
+void* operator new(const size_t size, const align_val_t alignment) {
+	++allocations;
+	const auto align = max(static_cast<size_t>(alignment), sizeof(void*));
+	#ifdef _WIN32
+		if (void* p = _aligned_malloc(size ? size : 1, align)) return p;
+	#else
+		if (void* p = nullptr; posix_memalign(&p, align, size ? size : 1) == 0) return p;
+	#endif
+	throw bad_alloc();
+}
+
+void* operator new[](const size_t size, const align_val_t alignment) {
+	return ::operator new(size, alignment);
+}
+
+void operator delete(void* p) noexcept				{ free(p); }
+void operator delete[](void* p) noexcept			{ free(p); }
+void operator delete(void* p, size_t) noexcept		{ free(p); }
+void operator delete[](void* p, size_t) noexcept	{ free(p); }
+
+#ifdef _WIN32
+	#define ALIGNED_FREE(p) _aligned_free(p)
+#else
+	#define ALIGNED_FREE(p) free(p)
+#endif
+
+void operator delete(void* p, align_val_t) noexcept				{ ALIGNED_FREE(p); }
+void operator delete[](void* p, align_val_t) noexcept			{ ALIGNED_FREE(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept		{ ALIGNED_FREE(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept	{ ALIGNED_FREE(p); }
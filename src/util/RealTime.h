@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * Opt-in real-time setup for the playback thread:
+ * raises the calling thread's scheduling priority (SCHED_FIFO on POSIX, time-critical on Windows)
+ * and pre-faults and locks the thread's stack.
+ * Every step is best effort and logged, since it usually needs extra privileges (e.g. rtprio limits or CAP_SYS_NICE).
+ * The rest of the playback working set is locked by its owner with lockMemory(): never the whole process,
+ * which would also pin the GUI, every soundfont and all other sessions against RLIMIT_MEMLOCK.
+ */
+void enterRealTimeMode();
+
+bool raiseThreadPriority();
+bool prefaultStack(size_t bytes);  // Also locks the touched pages, returns whether that worked
+
+/** Keep the pages of a buffer resident (mlock / VirtualLock), returns whether that worked */
+bool lockMemory(const void* data, size_t bytes);
+void unlockMemory(const void* data, size_t bytes);
+
+
+/** Number of heap allocations (global operator new) made by the calling thread so far */
+uint64_t threadAllocationCount();
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+
+/**
+ * Bounded lock-free FIFO between exactly one producer and one consumer thread.
+ * Cheaper than MPSCQueue (no CAS, each side caches the other side's index), for callbacks that are known
+ * to run on a single thread. Neither side ever blocks or allocates:
+ * push() fails when the queue is full and pop() returns nothing when it is empty.
+ */
+template<typename T, size_t Capacity>
+class SPSCQueue {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	/** Producer: false if the queue is full (the value is dropped) */
+	bool push(const T& value) {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - headCache == Capacity) {
+			headCache = head.load(std::memory_order_acquire);
+			if (t - headCache == Capacity) return false;
+		}
+		slots[t & MASK] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Consumer: oldest value, if any */
+	std::optional<T> pop() {
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tailCache) {
+			tailCache = tail.load(std::memory_order_acquire);
+			if (h == tailCache) return std::nullopt;
+		}
+		T value = slots[h & MASK];
+		head.store(h + 1, std::memory_order_release);
+		return value;
+	}
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	static constexpr size_t MASK = Capacity - 1;
+
+	std::array<T, Capacity> slots{};
+
+	// Producer and consumer indices on separate cache lines, each with a cached copy of the other side's index
+	alignas(64) std::atomic<size_t> tail{0};
+	size_t headCache = 0;
+	alignas(64) std::atomic<size_t> head{0};
+	size_t tailCache = 0;
+};
@@ -4,6 +4,10 @@
 
 #include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
 
 
 #define DOWNBEAT_PROB_THRESHOLD 0	// Stretch notes that are a downbeat with a higher probability than this
@@ -12,7 +16,13 @@
 inline double DOWNBEAT_STRETCH_TOLERANCE;	// If a note happens within thiS many ms of a downbeat, it can be stretched or squashed to land exactly on the downbeat
 
 
-using Clock = std::chrono::high_resolution_clock;
+using Clock = std::chrono::steady_clock;  // Monotonic: never jumps with system time adjustments
+
+constexpr auto DEFAULT_SPIN_WINDOW = std::chrono::microseconds(500);  // See preciseSleepUntil()
+
+// Musical timeline
+using Tick = int64_t;
+constexpr Tick PPQ = 960;  // Ticks per beat (TimeSignatureInfo's beat, i.e. 60e6 / bpm µs) of the generation timeline
 
 struct TimeSignatureInfo {
 	int num		= 4;
@@ -80,3 +90,111 @@ inline MusicTimePoint getMTP(
 
 	return MusicTimePoint{measure + 1, offset};
 }
+
+
+/** Busy-waits (yielding) until the given time, for the last few hundred µs of a wait */
+inline void spinUntil(const Clock::time_point time) {
+	while (Clock::now() < time)
+		std::this_thread::yield();
+}
+
+/**
+ * Sleeps until the given time more precisely than sleep_until, which commonly overshoots by 50–1000 µs:
+ * sleeps coarsely via `sleepUntil(time_point)` until `spinWindow` before the deadline, then spins for the rest.
+ * `sleepUntil` returns true to interrupt the wait (e.g. a condition variable wait whose predicate became true).
+ * Returns when the coarse sleep woke up (for jitter instrumentation), or nullopt if it was interrupted.
+ */
+template<typename SleepUntil>
+std::optional<Clock::time_point> preciseSleepUntil(
+	const Clock::time_point time,
+	SleepUntil&& sleepUntil,
+	const Clock::duration spinWindow = DEFAULT_SPIN_WINDOW
+) {
+	if (sleepUntil(time - spinWindow)) return std::nullopt;
+
+	const auto coarseWake = Clock::now();
+	spinUntil(time);
+	return coarseWake;
+}
+
+
+/**
+ * Maps the integer tick timeline to µs since playback start.
+ * Each tempo change starts a segment anchored at an exact tick and µs position, and every conversion is computed
+ * from its segment's anchor, so rounding never accumulates over a long session.
+ */
+class TempoMap {
+public:
+	explicit TempoMap(const double bpm = 120.0) {
+		reset(bpm);
+	}
+
+	void reset(const double bpm) {
+		segments.assign(1, {0, 0, usPerBeat(bpm)});
+	}
+
+	/** Change the tempo from the given tick on (must not be before the last tempo change) */
+	void setTempo(const Tick tick, const double bpm) {
+		const int64_t us = usPerBeat(bpm);
+		if (segments.back().usPerBeat == us) return;
+
+		if (segments.back().tick == tick)
+			segments.back().usPerBeat = us;
+		else
+			segments.push_back({tick, toMicros(tick), us});
+	}
+
+	[[nodiscard]] int64_t toMicros(const Tick tick) const {
+		const Segment& seg = segmentAt(tick);
+		return seg.micros + divRound((tick - seg.tick) * seg.usPerBeat, PPQ);
+	}
+
+	/** Last tick that starts at or before the given µs position */
+	[[nodiscard]] Tick toTick(const int64_t micros) const {
+		const Segment* seg = &segments.front();
+		for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+			if (it->micros <= micros) {
+				seg = &*it;
+				break;
+			}
+		}
+
+		Tick tick = seg->tick + floorDiv((micros - seg->micros) * PPQ, seg->usPerBeat);
+		while (toMicros(tick + 1) <= micros) ++tick;  // Compensate for toMicros() rounding
+		while (toMicros(tick) > micros) --tick;
+		return tick;
+	}
+
+	/** Forget tempo changes before the segment containing the given tick */
+	void trimBefore(const Tick tick) {
+		size_t keep = 0;
+		while (keep + 1 < segments.size() && segments[keep + 1].tick <= tick) ++keep;
+		segments.erase(segments.begin(), segments.begin() + static_cast<std::ptrdiff_t>(keep));
+	}
+
+private:
+	struct Segment {
+		Tick tick;
+		int64_t micros;
+		int64_t usPerBeat;
+	};
+	std::vector<Segment> segments;
+
+	static int64_t usPerBeat(const double bpm) {
+		return std::llround(60e6 / bpm);
+	}
+
+	static int64_t floorDiv(const int64_t a, const int64_t b) {
+		return a / b - (a % b != 0 && (a < 0) != (b < 0));
+	}
+
+	static int64_t divRound(const int64_t a, const int64_t b) {
+		return floorDiv(2 * a + b, 2 * b);
+	}
+
+	[[nodiscard]] const Segment& segmentAt(const Tick tick) const {
+		for (auto it = segments.rbegin(); it != segments.rend(); ++it)
+			if (it->tick <= tick) return *it;
+		return segments.front();
+	}
+};
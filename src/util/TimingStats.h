@@ -0,0 +1,288 @@
+#pragma once
+
+#include "Timing.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+
+/** Snapshot of a histogram's key figures (all values in µs, or permille for load histograms) */
+struct HistogramSummary {
+	uint64_t count = 0;
+	int64_t p50 = 0;
+	int64_t p99 = 0;
+	int64_t max = 0;
+};
+
+
+/**
+ * Fixed-size, lock-free histogram for non-negative integer samples (e.g. latencies in µs).
+ * Values below 8 get their own bucket, larger values are split into 8 sub-buckets per power of two,
+ * which keeps the relative error below 12.5% up to ~16 s with only 184 buckets.
+ * Recording is a couple of relaxed atomic increments, so it can be used from the playback thread.
+ */
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BITS    = 3;
+	static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+	static constexpr int MAX_MSB     = 24;
+	static constexpr int NUM_BUCKETS = (MAX_MSB - SUB_BITS + 2) * SUB_BUCKETS;
+
+	void record(int64_t value) {
+		if (value < 0) value = 0;  // Early events count as on time
+
+		counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		total.fetch_add(1, std::memory_order_relaxed);
+
+		int64_t prevMax = maxValue.load(std::memory_order_relaxed);
+		while (value > prevMax && !maxValue.compare_exchange_weak(prevMax, value, std::memory_order_relaxed)) {}
+	}
+
+	void reset() {
+		for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+		total.store(0, std::memory_order_relaxed);
+		maxValue.store(0, std::memory_order_relaxed);
+	}
+
+	[[nodiscard]] uint64_t count() const { return total.load(std::memory_order_relaxed); }
+	[[nodiscard]] int64_t max() const { return maxValue.load(std::memory_order_relaxed); }
+
+	/** Upper bound of the bucket containing the given percentile (0..100) */
+	[[nodiscard]] int64_t percentile(const double p) const {
+		const uint64_t n = count();
+		if (n == 0) return 0;
+
+		const auto rank = static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(n)));
+		uint64_t seen = 0;
+		for (int i = 0; i < NUM_BUCKETS; ++i) {
+			seen += counts[i].load(std::memory_order_relaxed);
+			if (seen >= rank && seen > 0)
+				return std::min(bucketUpperBound(i), max());
+		}
+		return max();
+	}
+
+	[[nodiscard]] HistogramSummary summary() const {
+		return { count(), percentile(50), percentile(99), max() };
+	}
+
+private:
+	std::array<std::atomic<uint32_t>, NUM_BUCKETS> counts{};
+	std::atomic<uint64_t> total{0};
+	std::atomic<int64_t> maxValue{0};
+
+	static int bucketIndex(const int64_t value) {
+		const auto v = static_cast<uint64_t>(value);
+		if (v < SUB_BUCKETS) return static_cast<int>(v);
+
+		const int msb = std::bit_width(v) - 1;
+		if (msb > MAX_MSB) return NUM_BUCKETS - 1;
+
+		const int group = msb - SUB_BITS + 1;
+		const int sub   = static_cast<int>((v >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+		return group * SUB_BUCKETS + sub;
+	}
+
+	static int64_t bucketUpperBound(const int idx) {
+		if (idx < SUB_BUCKETS) return idx;
+
+		const int group = idx / SUB_BUCKETS;
+		const int sub   = idx % SUB_BUCKETS;
+		return (static_cast<int64_t>(SUB_BUCKETS + sub + 1) << (group - 1)) - 1;
+	}
+};
+
+
+/** CSV row (metric, count, p50, p99, max) for a histogram, skipped while it is empty */
+inline void writeHistogramRow(std::ostream& f, const std::string& name, const LatencyHistogram& h) {
+	const auto [count, p50, p99, max] = h.summary();
+	if (count == 0) return;
+	f << name << ',' << count << ',' << p50 << ',' << p99 << ',' << max << '\n';
+}
+
+/** CSV row for a single counter, which only fills the count column */
+template<typename T>
+void writeCounterRow(std::ostream& f, const std::string& name, const std::atomic<T>& counter) {
+	f << name << ',' << counter.load(std::memory_order_relaxed) << ",,,\n";
+}
+
+
+/** Wake-up lateness of the play loop's timed waits: after the coarse sleep alone and after the final spin */
+struct WakeStats {
+	LatencyHistogram coarseLateness;	// µs, sleep overshoot before spinning
+	LatencyHistogram lateness;			// µs, after spinning
+
+	void record(const int64_t coarseLatenessUs, const int64_t latenessUs) {
+		coarseLateness.record(coarseLatenessUs);
+		lateness.record(latenessUs);
+	}
+
+	void reset() {
+		coarseLateness.reset();
+		lateness.reset();
+	}
+
+	void writeCSV(std::ostream& f) const {
+		writeHistogramRow(f, "coarse_wake_lateness_us", coarseLateness);
+		writeHistogramRow(f, "wake_lateness_us", lateness);
+	}
+};
+
+
+/** Heap allocations made while generating measures and while dispatching notes */
+struct AllocationStats {
+	LatencyHistogram perGeneration;			// Per measure generation (outside the arena)
+	std::atomic<uint64_t> dispatch{0};		// Inside the note dispatch loop (should stay 0)
+
+	void reset() {
+		perGeneration.reset();
+		dispatch.store(0, std::memory_order_relaxed);
+	}
+
+	void writeCSV(std::ostream& f) const {
+		writeHistogramRow(f, "generation_allocations", perGeneration);
+		writeCounterRow(f, "dispatch_allocations", dispatch);
+	}
+};
+
+
+/** Synth CPU load and voice count per measure, and measures that had layers shed because of them */
+struct SynthLoadStats {
+	LatencyHistogram cpuLoad;					// Permille of the audio period
+	LatencyHistogram voices;					// Active voices
+	std::atomic<uint64_t> shedMeasures{0};
+
+	void record(const double cpuLoadPercent, const int activeVoices, const int shedLevel) {
+		cpuLoad.record(static_cast<int64_t>(cpuLoadPercent * 10.0));
+		voices.record(activeVoices);
+		if (shedLevel > 0) shedMeasures.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		cpuLoad.reset();
+		voices.reset();
+		shedMeasures.store(0, std::memory_order_relaxed);
+	}
+
+	void writeCSV(std::ostream& f) const {
+		writeHistogramRow(f, "synth_cpu_load_permille", cpuLoad);
+		writeHistogramRow(f, "synth_active_voices", voices);
+		writeCounterRow(f, "synth_shed_measures", shedMeasures);
+	}
+};
+
+
+/** Startup: time to the first note, and how much of the soundfont load was hidden behind the other setup work */
+struct StartupStats {
+	std::atomic<int64_t> prepareTime{0};			// µs that prepare() took
+	std::atomic<int64_t> connectWaitTime{-1};		// µs from the end of prepare() until playback started (game connected)
+	std::atomic<int64_t> timeToFirstNote{-1};		// µs from the start of playback to the first note-on
+	std::atomic<int64_t> soundfontLoadTime{0};		// µs, in the background
+	std::atomic<int64_t> soundfontWaitTime{0};		// µs that prepare() still had to wait for it
+
+	void reset() {
+		prepareTime.store(0, std::memory_order_relaxed);
+		connectWaitTime.store(-1, std::memory_order_relaxed);
+		timeToFirstNote.store(-1, std::memory_order_relaxed);
+		soundfontLoadTime.store(0, std::memory_order_relaxed);
+		soundfontWaitTime.store(0, std::memory_order_relaxed);
+	}
+
+	void writeCSV(std::ostream& f) const {
+		writeCounterRow(f, "startup_prepare_us", prepareTime);
+		writeCounterRow(f, "startup_connect_wait_us", connectWaitTime);
+		writeCounterRow(f, "startup_time_to_first_note_us", timeToFirstNote);
+		writeCounterRow(f, "startup_soundfont_load_us", soundfontLoadTime);
+		writeCounterRow(f, "startup_soundfont_wait_us", soundfontWaitTime);
+	}
+};
+
+
+/**
+ * Playback timing instrumentation:
+ * - lateness of note-ons compared to their scheduled start time, in total and per MIDI channel
+ * - duration of each measure's generation phase, absolute and relative to the measure length
+ * - measures that needed generation fallbacks, and measures whose generation finished after they started
+ * Everything else that is measured during a session lives in its own stats struct below.
+ */
+class TimingStats {
+public:
+	static constexpr int NUM_CHANNELS = MIDI_CHANNELS;
+
+	LatencyHistogram noteLateness;									// µs
+	std::array<LatencyHistogram, NUM_CHANNELS> channelLateness;		// µs
+	LatencyHistogram generationTime;								// µs
+	LatencyHistogram generationLoad;								// Generation time in permille of the measure length
+	std::atomic<uint64_t> degradedMeasures{0};						// Generation budget exceeded, fallbacks used
+	std::atomic<uint64_t> deadlineMisses{0};						// Generation finished after the measure start
+
+	WakeStats wake;
+	AllocationStats allocations;
+	SynthLoadStats synth;
+	StartupStats startup;
+
+	void recordNoteLateness(const int channel, const int64_t latenessUs) {
+		noteLateness.record(latenessUs);
+		if (channel >= 0 && channel < NUM_CHANNELS)
+			channelLateness[channel].record(latenessUs);
+	}
+
+	void recordGeneration(const int64_t generationUs, const double measureUs) {
+		generationTime.record(generationUs);
+		if (measureUs > 0.0)
+			generationLoad.record(static_cast<int64_t>(1000.0 * static_cast<double>(generationUs) / measureUs));
+	}
+
+	void recordGenerationOutcome(const bool degraded, const bool missedDeadline) {
+		if (degraded)		degradedMeasures.fetch_add(1, std::memory_order_relaxed);
+		if (missedDeadline) deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		noteLateness.reset();
+		for (auto& h : channelLateness) h.reset();
+		generationTime.reset();
+		generationLoad.reset();
+		degradedMeasures.store(0, std::memory_order_relaxed);
+		deadlineMisses.store(0, std::memory_order_relaxed);
+		wake.reset();
+		allocations.reset();
+		synth.reset();
+		startup.reset();
+	}
+
+	/** Dumps all non-empty histograms as CSV rows (metric, count, p50, p99, max), counters only fill the count */
+	bool writeCSV(const std::string& path) const {
+		std::ofstream f(path);
+		if (!f) return false;
+
+		f << "metric,count,p50,p99,max\n";
+		writeHistogramRow(f, "note_lateness_us", noteLateness);
+		for (int ch = 0; ch < NUM_CHANNELS; ++ch)
+			writeHistogramRow(f, "note_lateness_us_ch" + std::to_string(ch), channelLateness[ch]);
+		writeHistogramRow(f, "generation_time_us", generationTime);
+		writeHistogramRow(f, "generation_load_permille", generationLoad);
+		writeCounterRow(f, "generation_degraded_measures", degradedMeasures);
+		writeCounterRow(f, "generation_deadline_misses", deadlineMisses);
+		wake.writeCSV(f);
+		allocations.writeCSV(f);
+		synth.writeCSV(f);
+		startup.writeCSV(f);
+
+		return true;
+	}
+};
+
+
+/** Elapsed time between two time points in whole µs (for instrumentation) */
+inline int64_t microsBetween(const Clock::time_point t0, const Clock::time_point t1) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+}
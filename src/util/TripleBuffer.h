@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+/**
+ * Lock-free single-writer/single-reader handoff of the latest value of T.
+ * The writer fills back() and publishes it. The reader calls read() to get the most recently published value,
+ * which stays valid and unchanged until its next read() call. Neither side ever blocks or allocates.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+	/** Writer: buffer to fill completely before calling publish() (it may contain an older value) */
+	T& back() { return buffers[backIdx]; }
+
+	/** Writer: make the back buffer the latest value */
+	void publish() {
+		backIdx = middle.exchange(static_cast<uint8_t>(backIdx | DIRTY), std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	/** Reader: latest published value */
+	const T& read() {
+		if (middle.load(std::memory_order_relaxed) & DIRTY)
+			frontIdx = middle.exchange(frontIdx, std::memory_order_acq_rel) & INDEX_MASK;
+		return buffers[frontIdx];
+	}
+
+private:
+	static constexpr uint8_t INDEX_MASK = 0b011;
+	static constexpr uint8_t DIRTY      = 0b100;  // Set when the middle buffer holds a value the reader hasn't seen yet
+
+	std::array<T, 3> buffers{};
+	uint8_t backIdx = 0;				// Owned by the writer
+	std::atomic<uint8_t> middle{1};		// Exchanged between writer and reader
+	uint8_t frontIdx = 2;				// Owned by the reader
+};
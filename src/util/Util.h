@@ -27,6 +27,8 @@
 #define NOTE_ON			0x90
 #define NOTE_OFF		0x80
 
+constexpr int MIDI_CHANNELS = 64;	// FluidSynth extended channels (synth.midi-channels), 4 banks of 16
+
 #define MIN_PAUSE_LENGTH 100		// Musical pauses have to be at least this long (in ms) to count as pauses
 
 
@@ -0,0 +1,75 @@
+#include "../src/algo/ChordDetector.h"
+#include "../src/algo/KeyDetector.h"
+#include "../src/util/RealTime.h"
+
+#include <array>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+
+using namespace std;
+
+
+/**
+ * Verifies that chord detection and theme fitting don't touch the heap once warmed up: scoreChords(), getChord()
+ * and fitNoteToChord() run against a fixed arena (like the per-measure generation arena) on random segments
+ * while the calling thread's allocations are counted by the replaced global operator new (see util/RealTime.h).
+ *
+ * Usage: ChordAllocationTest [iterations]
+ */
+
+constexpr size_t SEGMENT_LENGTH = 16;
+constexpr size_t ARENA_BYTES	= 16 * 1024;
+
+/** Swallows getChord()'s console output, but still lets it be formatted */
+struct NullBuffer final : streambuf {
+	int overflow(const int c) override { return c; }
+};
+
+
+int main(const int argc, char* argv[]) {
+	const int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+
+	// Fixed buffer without upstream: running out throws instead of falling back to the heap
+	alignas(max_align_t) static array<byte, ARENA_BYTES> buffer;
+	pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), pmr::null_memory_resource());
+
+	mt19937 rng(42);
+	uniform_int_distribution<int> noteDist(48, 84);
+	array<Note, SEGMENT_LENGTH> segment{};
+
+	NullBuffer nullBuffer;
+	streambuf* const coutBuffer = cout.rdbuf(&nullBuffer);
+
+	uint64_t allocations = 0;
+	int checksum = 0;
+	for (int i = -1; i < iterations; ++i) {  // Iteration -1 only warms up (stream state)
+		// A new key or mode rebuilds the diatonic chords, which may allocate: once per measure, outside the check
+		const auto key = static_cast<Note>(rng() % 12);
+		const auto scale = static_cast<Scale>(rng() % 7);
+		generateDiatonicChords(key, scale);
+		for (Note& note : segment) note = static_cast<Note>(noteDist(rng));
+
+		const uint64_t before = threadAllocationCount();
+		arena.release();
+
+		checksum += static_cast<int>(scoreChords(segment, scale, &arena).size());
+		const Chord& chord = getChord(segment, scale, &arena);
+		if (&chord != &NO_CHORD)
+			for (const Note note : segment)
+				checksum += fitNoteToChord(note, key, chord);
+
+		if (i >= 0) allocations += threadAllocationCount() - before;
+	}
+
+	cout.rdbuf(coutBuffer);
+
+	if (allocations > 0) {
+		cerr << "[ChordAllocationTest] FAILED: " << allocations << " heap allocations in " << iterations
+			 << " iterations (checksum " << checksum << ")\n";
+		return EXIT_FAILURE;
+	}
+	cout << "[ChordAllocationTest] Passed: no heap allocations in " << iterations << " iterations (checksum "
+		 << checksum << ")\n";
+	return EXIT_SUCCESS;
+}
@@ -41,16 +41,17 @@ void MusicMaker::startPT(const string& file) {
 	preloadMIDIFile(file);
 
 	// Get input training MIDI
-	MidiFile mainMIDIFile = getCachedMIDI(file);
+	MidiFile mainMIDIFile = *getCachedMIDI(file);
 
 	// Extract bpm and time signature
 	tsInfo = extractTimeSignatureInfo(mainMIDIFile);
 	originalBpm = tsInfo.bpm;
 
-	// Generate the drum pattern map
-	drumPatterns = getDrumPatterns(tsInfo);
+	// Compile the drum patterns for the input's meter
+	drumPatterns = drumPatternLibrary.compile(tsInfo);
 
 	// Extract melody
+	Melody melody{};
 	processMidiEvents(mainMIDIFile, tsInfo, [&](
 		const Note note,
 		const Clock::time_point eventStartTime,
@@ -0,0 +1,145 @@
+#include "../src/game/GameData.h"
+#include "../src/game/GameStateProtocol.h"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using nlohmann::json;
+
+
+/**
+ * Compares the game state encodings the GameBridge accepts: newline-delimited JSON (parsed into a DOM, as the
+ * receiver does), MessagePack (same DOM, nlohmann's binary format) and the compact binary frames with interned IDs.
+ * Random Minecraft states are generated per enemy count; reported are the bytes per update, the resulting bytes/s
+ * at the given update rate, and the mean parse cost per update (including reading out every field).
+ *
+ * Usage: ProtocolBenchmark [updates per second] [iterations per configuration]
+ */
+
+constexpr auto BENCHMARK_CSV = "protocol_benchmark.csv";
+
+const vector ENEMY_COUNTS = {0, 8, 32, 128, 256};
+
+
+struct Sample {
+	json document;
+	GameStateProtocol::GameState state;
+};
+
+Sample makeSample(mt19937& rng, const size_t enemyCount) {
+	const GameData& game = Minecraft;
+	uniform_int_distribution<size_t> mobDist(0, game.mobsList.size() - 1);
+	uniform_int_distribution<size_t> envDist(0, game.envList.size() - 1);
+	uniform_int_distribution<size_t> tagDist(0, game.tagsList.size() - 1);
+	uniform_real_distribution<float> distanceDist(0.0f, 64.0f);
+	uniform_real_distribution<float> healthDist(0.0f, 1.0f);
+
+	Sample sample;
+	auto& [document, state] = sample;
+
+	state.playerHealth = healthDist(rng);
+	state.environment = static_cast<uint16_t>(envDist(rng));
+	state.tags = {static_cast<uint8_t>(tagDist(rng)), static_cast<uint8_t>(tagDist(rng))};
+	for (size_t i = 0; i < enemyCount; ++i)
+		state.enemies.push_back({static_cast<uint16_t>(mobDist(rng)), distanceDist(rng)});
+
+	document["playerHealth"] = state.playerHealth;
+	document["environment"] = {{"type", game.envList[state.environment]}, {"tags", json::array()}};
+	for (const uint8_t tag : state.tags)
+		document["environment"]["tags"].push_back(game.tagsList[tag]);
+	document["enemies"] = json::array();
+	for (const auto& [mob, distance] : state.enemies)
+		document["enemies"].push_back({{"type", game.mobsList[mob]}, {"distance", distance}});
+
+	return sample;
+}
+
+
+/** Read out what handleGameState() would, so that lazy formats don't get away with skipping work */
+double consume(const json& document) {
+	double sum = document["playerHealth"].get<double>();
+	sum += static_cast<double>(document["environment"]["type"].get_ref<const string&>().size());
+	for (const auto& tag : document["environment"]["tags"])
+		sum += static_cast<double>(tag.get_ref<const string&>().size());
+	for (const auto& enemy : document["enemies"])
+		sum += static_cast<double>(enemy["type"].get_ref<const string&>().size()) + enemy["distance"].get<double>();
+	return sum;
+}
+
+double consume(const GameStateProtocol::GameState& state, const GameData& game) {
+	double sum = state.playerHealth;
+	sum += static_cast<double>(game.envList[state.environment].size());
+	for (const uint8_t tag : state.tags)
+		sum += static_cast<double>(game.tagsList[tag].size());
+	for (const auto& [mob, distance] : state.enemies)
+		sum += static_cast<double>(game.mobsList[mob].size()) + distance;
+	return sum;
+}
+
+
+/** Mean microseconds per call of `parse` */
+template<typename F>
+double measure(const int iterations, F&& parse) {
+	const auto start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) parse();
+	return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+
+int main(const int argc, char* argv[]) {
+	const double updateRate = argc > 1 ? atof(argv[1]) : 60.0;
+	const int iterations	= argc > 2 ? atoi(argv[2]) : 2000;
+
+	ofstream csv(BENCHMARK_CSV);
+	csv << "enemies,format,bytes_per_update,bytes_per_second,parse_us\n";
+
+	mt19937 rng(42);
+	volatile double sink = 0.0;  // Keeps the parsed results alive
+
+	cout << "enemies  format    bytes/update   bytes/s  parse_us\n";
+	for (const int enemyCount : ENEMY_COUNTS) {
+		const auto [document, state] = makeSample(rng, enemyCount);
+
+		const string line = document.dump() + '\n';
+		const vector<uint8_t> msgpack = json::to_msgpack(document);
+		string frame;
+		GameStateProtocol::encode(state, frame);
+
+		GameStateProtocol::GameState decoded;
+		const string_view frameBody = string_view(frame).substr(GameStateProtocol::LENGTH_BYTES);
+
+		const struct {
+			const char* name;
+			size_t bytes;
+			double parseUs;
+		} results[] = {
+			{"json", line.size(), measure(iterations, [&] {
+				sink = sink + consume(json::parse(string_view(line).substr(0, line.size() - 1)));
+			})},
+			{"msgpack", msgpack.size(), measure(iterations, [&] {
+				sink = sink + consume(json::from_msgpack(msgpack));
+			})},
+			{"binary", frame.size(), measure(iterations, [&] {
+				if (GameStateProtocol::decode(frameBody, decoded)) sink = sink + consume(decoded, Minecraft);
+			})},
+		};
+
+		for (const auto& [name, bytes, parseUs] : results) {
+			cout << fixed << setprecision(3)
+				 << setw(7) << enemyCount << "  " << left << setw(8) << name << right
+				 << setw(14) << bytes << setw(10) << static_cast<size_t>(bytes * updateRate) << setw(10) << parseUs << "\n";
+			csv << enemyCount << ',' << name << ',' << bytes << ',' << bytes * updateRate << ',' << parseUs << '\n';
+		}
+	}
+
+	cout << "[ProtocolBenchmark] Results written to " << BENCHMARK_CSV << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+#include "../src/output/FluidSynthSink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * Sweeps the synth settings (cores, period size and count, polyphony, sample rate) and renders a dense,
+ * constantly retriggered texture offline with each of them. Reports the output latency the settings imply and
+ * how long rendering one period takes compared to the period itself (load), to tune latency against CPU.
+ *
+ * Usage: SynthBenchmark [soundfont] [seconds per configuration]
+ */
+
+constexpr auto BENCHMARK_CSV = "synth_benchmark.csv";
+
+const vector CPU_CORES	  = {1, 2, 4};
+const vector PERIOD_SIZES = {64, 128, 256, 512};
+const vector PERIODS	  = {2, 4};
+const vector POLYPHONIES  = {64, 256};
+const vector SAMPLE_RATES = {44100.0, 48000.0};
+
+constexpr int VOICES_PER_HIT = 48;		// Notes started per retrigger, spread over 16 channels
+constexpr double HIT_INTERVAL = 0.25;	// Seconds between retriggers
+
+
+struct BenchmarkResult {
+	double latencyMs;
+	double meanRenderUs;
+	double maxRenderUs;
+	double load;	// Mean render time / period duration
+	int overruns;	// Periods that took longer to render than to play (would underrun live)
+	int peakVoices;
+};
+
+BenchmarkResult runConfiguration(const SynthSettings& synthSettings, const string& soundfont, const double seconds) {
+	fluid_settings_t* settings = new_fluid_settings();
+	FluidSynthSink::applySettings(settings, synthSettings);
+	fluid_synth_t* synth = new_fluid_synth(settings);
+
+	const int sfid = fluid_synth_sfload(synth, soundfont.c_str(), 1);
+	if (sfid == FLUID_FAILED) {
+		cerr << "[SynthBenchmark] Failed to load soundfont: " << soundfont << endl;
+		exit(EXIT_FAILURE);
+	}
+	for (int channel = 0; channel < 16; ++channel)
+		if (channel != 9) fluid_synth_program_select(synth, channel, sfid, 0, channel * 8);
+
+	const int frames = synthSettings.periodSize;
+	vector<float> left(frames), right(frames);
+	const double periodUs = 1e6 * frames / synthSettings.sampleRate;
+	const int totalPeriods = static_cast<int>(seconds * synthSettings.sampleRate / frames);
+	const int periodsPerHit = max(1, static_cast<int>(HIT_INTERVAL * synthSettings.sampleRate / frames));
+
+	mt19937 rng(42);  // Same notes for every configuration
+	uniform_int_distribution noteDist(36, 96);
+	vector<pair<int, int>> sounding;  // channel, note
+
+	BenchmarkResult result{};
+	result.latencyMs = 1000.0 * synthSettings.periods * frames / synthSettings.sampleRate;
+
+	double totalUs = 0.0;
+	for (int period = 0; period < totalPeriods; ++period) {
+		if (period % periodsPerHit == 0) {
+			for (const auto& [channel, note] : sounding)
+				fluid_synth_noteoff(synth, channel, note);
+			sounding.clear();
+			for (int i = 0; i < VOICES_PER_HIT; ++i) {
+				const int channel = i % 16;
+				const int note = noteDist(rng);
+				fluid_synth_noteon(synth, channel, note, 100);
+				sounding.emplace_back(channel, note);
+			}
+		}
+
+		const auto start = chrono::steady_clock::now();
+		fluid_synth_write_float(synth, frames, left.data(), 0, 1, right.data(), 0, 1);
+		const double renderUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+		totalUs += renderUs;
+		result.maxRenderUs = max(result.maxRenderUs, renderUs);
+		if (renderUs > periodUs) ++result.overruns;
+		result.peakVoices = max(result.peakVoices, fluid_synth_get_active_voice_count(synth));
+	}
+
+	result.meanRenderUs = totalPeriods > 0 ? totalUs / totalPeriods : 0.0;
+	result.load = result.meanRenderUs / periodUs;
+
+	delete_fluid_synth(synth);
+	delete_fluid_settings(settings);
+	return result;
+}
+
+
+int main(const int argc, char* argv[]) {
+	const string soundfont = argc > 1 ? argv[1] : string(RESOURCES_DIR) + "soundfonts/FluidR3_GM.sf2";
+	const double seconds   = argc > 2 ? atof(argv[2]) : 5.0;
+
+	ofstream csv(BENCHMARK_CSV);
+	csv << "cpu_cores,period_size,periods,polyphony,sample_rate,latency_ms,mean_render_us,max_render_us,load,overruns,peak_voices\n";
+
+	cout << "cores  period  periods  polyphony  rate    latency_ms  mean_us  max_us   load   overruns  voices\n";
+	for (const int cores : CPU_CORES)
+	for (const int periodSize : PERIOD_SIZES)
+	for (const int periods : PERIODS)
+	for (const int polyphony : POLYPHONIES)
+	for (const double sampleRate : SAMPLE_RATES) {
+		const SynthSettings synthSettings{cores, periodSize, periods, polyphony, sampleRate};
+		const auto [latencyMs, meanUs, maxUs, load, overruns, peakVoices] = runConfiguration(synthSettings, soundfont, seconds);
+
+		cout << fixed << setprecision(2)
+			 << setw(5) << cores << setw(8) << periodSize << setw(9) << periods << setw(11) << polyphony
+			 << setw(8) << static_cast<int>(sampleRate) << setw(12) << latencyMs << setw(9) << meanUs
+			 << setw(8) << maxUs << setw(7) << load << setw(10) << overruns << setw(8) << peakVoices << "\n";
+		csv << cores << ',' << periodSize << ',' << periods << ',' << polyphony << ',' << sampleRate << ','
+			<< latencyMs << ',' << meanUs << ',' << maxUs << ',' << load << ',' << overruns << ',' << peakVoices << '\n';
+	}
+
+	cout << "[SynthBenchmark] Results written to " << BENCHMARK_CSV << endl;
+	return EXIT_SUCCESS;
+}